@@ -70,6 +70,10 @@ kernel driver, and sends them back to the kernel using uinput devices.
 %{_bindir}/iptsd-find-hidraw
 %{_bindir}/iptsd-find-service
 %{_bindir}/iptsd-perf
+%{_bindir}/iptsd-perf-algorithms
+%{_bindir}/iptsd-perf-golden
+%{_bindir}/iptsd-perf-parser
+%{_bindir}/iptsd-perf-synthesize
 %{_bindir}/iptsd-plot
 %{_bindir}/iptsd-show
 %{_unitdir}/iptsd@.service
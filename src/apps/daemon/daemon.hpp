@@ -6,6 +6,7 @@
 #include "stylus.hpp"
 #include "touch.hpp"
 
+#include <common/latency.hpp>
 #include <common/types.hpp>
 #include <contacts/contact.hpp>
 #include <core/generic/application.hpp>
@@ -44,6 +45,16 @@ public:
 			spdlog::warn("Stylus is disabled!");
 	}
 
+	void on_timeout() override
+	{
+		// The device went silent, make sure that no inputs are stuck.
+		if (m_touch.active())
+			m_touch.update({});
+
+		if (m_stylus.active())
+			m_stylus.update(ipts::StylusData {});
+	}
+
 	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
 	{
 		if (m_config.touch_disable)
@@ -53,7 +64,10 @@ public:
 		if (m_config.touch_disable_on_stylus && !m_stylus.active() && !m_touch.enabled())
 			m_touch.enable();
 
+		latency::Stopwatch watch {};
+
 		m_touch.update(contacts);
+		watch.lap(latency::Stage::Emit);
 	}
 
 	void on_stylus(const ipts::StylusData &stylus) override
@@ -64,7 +78,10 @@ public:
 		if (m_config.touch_disable_on_stylus && m_touch.enabled())
 			m_touch.disable();
 
+		latency::Stopwatch watch {};
+
 		m_stylus.update(stylus);
+		watch.lap(latency::Stage::Emit);
 	}
 };
 
@@ -2,8 +2,12 @@
 
 #include "daemon.hpp"
 
+#include <common/chrono.hpp>
+#include <common/trace.hpp>
 #include <common/types.hpp>
-#include <core/linux/device-runner.hpp>
+#include <core/generic/config.hpp>
+#include <core/linux/multi-device-runner.hpp>
+#include <core/linux/realtime.hpp>
 #include <core/linux/signal-handler.hpp>
 
 #include <CLI/CLI.hpp>
@@ -14,7 +18,9 @@
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace iptsd::apps::daemon {
 namespace {
@@ -23,19 +29,100 @@ int run(const int argc, const char **argv)
 {
 	CLI::App app {"Daemon to translate touchscreen inputs to Linux input events."};
 
-	std::filesystem::path path {};
-	app.add_option("DEVICE", path)
-		->description("The hidraw device node of the touchscreen.")
+	std::vector<std::filesystem::path> paths {};
+	app.add_option("DEVICE", paths)
+		->description("The hidraw device nodes of the touchscreens.")
 		->type_name("FILE")
 		->required();
 
+	usize timeout = 0;
+	app.add_option("-t,--timeout", timeout)
+		->description("Lift all inputs if a device didn't send data for this long (in ms).")
+		->type_name("MS");
+
+	std::string scheduler {};
+	CLI::Option *scheduler_opt = app.add_option("--scheduler", scheduler)
+					     ->description("Scheduling class of the daemon.")
+					     ->check(CLI::IsMember({"other", "fifo", "rr"}))
+					     ->type_name("CLASS");
+
+	i32 priority = 0;
+	CLI::Option *priority_opt = app.add_option("--priority", priority)
+					    ->description("Real-time priority of the daemon.")
+					    ->check(CLI::Range(0, 99));
+
+	std::string cpus {};
+	CLI::Option *cpus_opt = app.add_option("--cpus", cpus)
+					->description("Pin the daemon to these CPUs (e.g. 0,2-3).")
+					->type_name("LIST");
+
+	bool lock_memory = false;
+	CLI::Option *lock_memory_opt =
+		app.add_flag("--lock-memory", lock_memory)
+			->description("Lock all memory of the daemon to avoid page faults.");
+
+	i32 slack = 0;
+	CLI::Option *slack_opt = app.add_option("--timer-slack", slack)
+					 ->description("Timer slack of the daemon (in ns).")
+					 ->type_name("NS");
+
+	std::filesystem::path stats {};
+	CLI::Option *stats_opt = app.add_option("--stats", stats)
+					 ->description("Write latencies to this file on SIGUSR1.")
+					 ->type_name("FILE");
+
+	std::filesystem::path trace {};
+	CLI::Option *trace_opt =
+		app.add_option("--trace", trace)
+			->description("Write a trace to this file on SIGUSR1 and on exit.")
+			->type_name("FILE");
+
 	CLI11_PARSE(app, argc, argv);
 
-	// Create a daemon application that reads from a device.
-	core::linux::DeviceRunner<Daemon> daemon {path};
+	if (trace_opt->count() > 0 && !trace::ENABLED)
+		spdlog::warn("Tracing was disabled at compile time, traces will be empty");
+
+	std::optional<chrono::milliseconds> lift_after = std::nullopt;
+	if (timeout > 0)
+		lift_after = chrono::milliseconds {timeout};
+
+	// Create a daemon application for every device, all served by a single event loop.
+	core::linux::MultiDeviceRunner<Daemon> daemon {};
+
+	for (const std::filesystem::path &path : paths)
+		daemon.add(path, lift_after);
+
+	if (stats_opt->count() > 0)
+		daemon.stats_file(stats);
+
+	if (trace_opt->count() > 0)
+		daemon.trace_file(trace);
+
+	// The real-time settings apply to the whole process, they are taken from the first device.
+	core::Config config = daemon.application(0).config();
+
+	if (scheduler_opt->count() > 0)
+		config.daemon_scheduler = scheduler;
+
+	if (priority_opt->count() > 0)
+		config.daemon_priority = priority;
+
+	if (cpus_opt->count() > 0)
+		config.daemon_cpus = cpus;
+
+	if (lock_memory_opt->count() > 0)
+		config.daemon_lock_memory = lock_memory;
+
+	if (slack_opt->count() > 0)
+		config.daemon_timer_slack = slack;
+
+	// Do this after all buffers were allocated, so that they are locked in memory.
+	core::linux::realtime::apply(config);
 
 	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { daemon.stop(); });
 	const auto _sigint = core::linux::signal<SIGINT>([&](int) { daemon.stop(); });
+	const auto _sighup = core::linux::signal<SIGHUP>([&](int) { daemon.reload(); });
+	const auto _sigusr1 = core::linux::signal<SIGUSR1>([&](int) { daemon.report(); });
 
 	if (!daemon.run())
 		return EXIT_FAILURE;
@@ -78,6 +78,10 @@ public:
 	/*!
 	 * Passes stylus data to the linux kernel.
 	 *
+	 * Every call is committed as a separate evdev frame. If the parser passes every sample
+	 * of a stylus report, the compositor receives all of them instead of only the last one.
+	 * The timestamp of the sample is forwarded through ABS_MISC.
+	 *
 	 * @param[in] data The current state of the stylus.
 	 */
 	void update(const ipts::StylusData &data)
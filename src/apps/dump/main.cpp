@@ -35,10 +35,14 @@ int run(const int argc, const char **argv)
 		->type_name("FILE")
 		->required();
 
+	bool delta = false;
+	app.add_flag("--delta", delta)
+		->description("Store reports as the difference to the previous one.");
+
 	CLI11_PARSE(app, argc, argv);
 
 	// Create a dumping application that reads from a device.
-	core::linux::DeviceRunner<Dump> dump {path, output};
+	core::linux::DeviceRunner<Dump> dump {path, output, delta};
 
 	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { dump.stop(); });
 	const auto _sigint = core::linux::signal<SIGINT>([&](int) { dump.stop(); });
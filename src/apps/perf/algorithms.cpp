@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/constants.hpp>
+#include <common/types.hpp>
+#include <contacts/detection/algorithms.hpp>
+
+#include <CLI/CLI.hpp>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::perf::algorithms {
+namespace {
+
+namespace detection = contacts::detection;
+
+/*
+ * The dimensions of a synthetic heatmap.
+ */
+struct Size {
+	const char *name;
+	Eigen::Index rows;
+	Eigen::Index cols;
+};
+
+// From small grids of older devices (e.g. Surface Pro 4) up to large modern sensors.
+constexpr std::array<Size, 3> SIZES {
+	Size {"small", 44, 64},
+	Size {"medium", 72, 128},
+	Size {"large", 96, 192},
+};
+
+// How many fingers are placed on the heatmap. A negative value means a palm.
+constexpr std::array<int, 6> CONTACTS {0, 1, 5, 10, 20, -1};
+
+// The thresholds that the daemon uses by default.
+constexpr f64 ACTIVATION = 24.0 / 255.0;
+constexpr f64 DEACTIVATION = 20.0 / 255.0;
+
+/*
+ * Keeps a value alive, so that the compiler can't optimize the computation of it away.
+ */
+template <class T>
+void keep(const T &value)
+{
+	// NOLINTNEXTLINE(hicpp-no-assembler)
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*!
+ * Adds a gaussian blob to the heatmap.
+ *
+ * @param[in,out] heatmap The heatmap to draw on.
+ * @param[in] x The horizontal center of the blob.
+ * @param[in] y The vertical center of the blob.
+ * @param[in] sx The horizontal standard deviation of the blob.
+ * @param[in] sy The vertical standard deviation of the blob.
+ * @param[in] amplitude The value at the center of the blob.
+ */
+template <class T>
+void blob(Image<T> &heatmap, const f64 x, const f64 y, const f64 sx, const f64 sy,
+	  const f64 amplitude)
+{
+	for (Eigen::Index r = 0; r < heatmap.rows(); r++) {
+		for (Eigen::Index c = 0; c < heatmap.cols(); c++) {
+			const f64 dx = (casts::to<f64>(c) - x) / sx;
+			const f64 dy = (casts::to<f64>(r) - y) / sy;
+			const f64 value = amplitude * std::exp(-0.5 * (dx * dx + dy * dy));
+
+			heatmap(r, c) += gsl::narrow_cast<T>(value);
+		}
+	}
+}
+
+/*!
+ * Creates a heatmap that looks like the normalized data of a real device.
+ *
+ * The values are quantized to steps of 1/255, with a noisy background around
+ * a neutral value and gaussian blobs for fingers or a palm.
+ *
+ * @param[in] size The dimensions of the heatmap.
+ * @param[in] contacts How many fingers to place, or a negative value for a palm.
+ * @return The synthetic heatmap.
+ */
+template <class T>
+Image<T> heatmap(const Size &size, const int contacts)
+{
+	// Use a fixed seed, so that every run measures the same data.
+	std::mt19937 rng {casts::to<u32>(size.rows * size.cols + contacts + 100)};
+
+	std::uniform_int_distribution<int> noise {0, 3};
+	std::uniform_real_distribution<f64> amplitude {0.3, 0.6};
+	std::uniform_real_distribution<f64> sigma {0.9, 1.4};
+	std::uniform_real_distribution<f64> x {2, casts::to<f64>(size.cols - 3)};
+	std::uniform_real_distribution<f64> y {2, casts::to<f64>(size.rows - 3)};
+
+	Image<T> heatmap {size.rows, size.cols};
+
+	for (Eigen::Index r = 0; r < size.rows; r++) {
+		for (Eigen::Index c = 0; c < size.cols; c++)
+			heatmap(r, c) = casts::to<T>(8 + noise(rng)) / casts::to<T>(255);
+	}
+
+	if (contacts < 0) {
+		const f64 cx = casts::to<f64>(size.cols) * 0.6;
+		const f64 cy = casts::to<f64>(size.rows) * 0.5;
+
+		blob(heatmap, cx, cy, 5.0, 4.0, 0.5);
+	}
+
+	for (int i = 0; i < contacts; i++)
+		blob(heatmap, x(rng), y(rng), sigma(rng), sigma(rng), amplitude(rng));
+
+	// Quantize like the 8 bit data of the device.
+	heatmap = (heatmap.cwiseMin(1) * 255).round() / 255;
+
+	return heatmap;
+}
+
+/*!
+ * Runs a function repeatedly for a while and measures how long one call takes.
+ *
+ * @param[in] duration For how long the function should be run.
+ * @param[in] func The function to measure.
+ * @return The average time per call (in nanoseconds).
+ */
+template <class F>
+f64 measure(const chrono::steady_clock::duration duration, F &&func)
+{
+	using clock = chrono::steady_clock;
+
+	// Warm up the caches and let the CPU leave power saving states.
+	func();
+
+	usize calls = 0;
+	const clock::time_point start = clock::now();
+	clock::time_point now = start;
+
+	// Check the time in batches, to keep the clock out of the measurement of fast functions.
+	do {
+		for (usize i = 0; i < 16; i++)
+			func();
+
+		calls += 16;
+		now = clock::now();
+	} while (now - start < duration);
+
+	const f64 total = chrono::duration_cast<nanoseconds<f64>>(now - start).count();
+	return total / casts::to<f64>(calls);
+}
+
+/*!
+ * Measures all detection algorithms on one synthetic heatmap.
+ *
+ * Every algorithm gets the same input that it would get inside of the detector.
+ *
+ * @param[in] size The dimensions of the heatmap.
+ * @param[in] contacts How many fingers to place, or a negative value for a palm.
+ * @param[in] duration For how long each algorithm should be run.
+ * @param[in] filter Only measure algorithms whose name contains this string.
+ */
+template <class T>
+void run_case(const Size &size,
+	      const int contacts,
+	      const chrono::steady_clock::duration duration,
+	      const std::string &filter)
+{
+	const Image<T> input = heatmap<T>(size, contacts);
+	const Matrix3<T> kernel = detection::kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+
+	const auto athresh = gsl::narrow_cast<T>(ACTIVATION);
+	const auto dthresh = gsl::narrow_cast<T>(DEACTIVATION);
+
+	const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+	const Vector2<Eigen::Index> dimensions {size.cols - 1, size.rows - 1};
+
+	// Prepare the inputs of every stage, exactly like the detector does.
+	using Algorithm = detection::neutral::Algorithm;
+	const T neutral = detection::neutral::calculate(input, Algorithm::MODE, Zero<T>());
+
+	const Image<T> subtracted = (input - neutral).max(Zero<T>());
+
+	Image<T> blurred {size.rows, size.cols};
+	detection::convolution::run(subtracted, kernel, blurred);
+
+	std::vector<Point> maximas {};
+	detection::maximas::find(blurred, athresh, maximas);
+
+	std::vector<Box> clusters {};
+
+	for (const Point &point : maximas) {
+		Box cluster = detection::cluster::span(blurred, point, athresh, dthresh);
+
+		if (cluster.isEmpty())
+			continue;
+
+		cluster.min() = (cluster.min() - one).cwiseMax(0);
+		cluster.max() = (cluster.max() + one).cwiseMin(dimensions);
+
+		const Vector2<Eigen::Index> extent = cluster.sizes() + one;
+		if (extent.x() < 3 || extent.y() < 3)
+			continue;
+
+		clusters.push_back(cluster);
+	}
+
+	std::vector<Box> merged = clusters;
+	std::vector<Box> temp {};
+	detection::overlaps::merge(merged, temp, 5);
+
+	std::vector<detection::gaussian::Parameters<T>> params {};
+
+	for (const Box &cluster : merged) {
+		const Vector2<Eigen::Index> extent = cluster.sizes() + one;
+
+		params.push_back(detection::gaussian::Parameters<T> {
+			true, 1, cluster.cast<T>().center(), Matrix2<T>::Identity(), cluster,
+			Image<T> {extent.y(), extent.x()}});
+	}
+
+	std::vector<detection::gaussian::Parameters<T>> fitted = params;
+	Image<T> fit_temp {size.rows, size.cols};
+
+	Image<T> out {size.rows, size.cols};
+	std::vector<Point> found {};
+	std::vector<Box> spanned {};
+
+	std::vector<std::pair<const char *, std::function<void()>>> algorithms {};
+
+	algorithms.emplace_back("neutral", [&] {
+		keep(detection::neutral::calculate(input, Algorithm::MODE, Zero<T>()));
+	});
+
+	algorithms.emplace_back("convolution", [&] {
+		detection::convolution::run(subtracted, kernel, out);
+		keep(out);
+	});
+
+	// The cost of a separable blur should only grow linearly with its size.
+	const std::array<Vector<T>, 3> separable {
+		detection::kernels::gaussian_1d<T>(3, gsl::narrow_cast<T>(0.75)),
+		detection::kernels::gaussian_1d<T>(5, gsl::narrow_cast<T>(1.0)),
+		detection::kernels::gaussian_1d<T>(9, gsl::narrow_cast<T>(2.0)),
+	};
+
+	Image<T> horizontal {size.rows, size.cols};
+
+	algorithms.emplace_back("separable-3", [&] {
+		detection::convolution::run_separable(subtracted, separable[0], horizontal, out);
+		keep(out);
+	});
+
+	algorithms.emplace_back("separable-5", [&] {
+		detection::convolution::run_separable(subtracted, separable[1], horizontal, out);
+		keep(out);
+	});
+
+	algorithms.emplace_back("separable-9", [&] {
+		detection::convolution::run_separable(subtracted, separable[2], horizontal, out);
+		keep(out);
+	});
+
+	Array<T> limits {};
+
+	algorithms.emplace_back("maximas", [&] {
+		detection::maximas::find(blurred, athresh, limits, found);
+		keep(found);
+	});
+
+	// Subtraction, separable-3 and maximas, fused into a single sweep.
+	detection::preprocess::Sweep<T> sweep {};
+
+	algorithms.emplace_back("preprocess", [&] {
+		sweep.run(input, neutral, separable[0], athresh, out, found);
+		keep(found);
+	});
+
+	algorithms.emplace_back("cluster", [&] {
+		spanned.clear();
+
+		for (const Point &point : maximas) {
+			const Box box = detection::cluster::span(blurred, point, athresh, dthresh);
+			spanned.push_back(box);
+		}
+
+		keep(spanned);
+	});
+
+	detection::cluster::Labeling<T> labeling {};
+
+	algorithms.emplace_back("labeling", [&] {
+		labeling.span(blurred, maximas, athresh, dthresh, spanned);
+		keep(spanned);
+	});
+
+	algorithms.emplace_back("overlaps", [&] {
+		spanned.assign(clusters.begin(), clusters.end());
+		detection::overlaps::merge(spanned, temp, 5);
+		keep(spanned);
+	});
+
+	algorithms.emplace_back("gaussian", [&] {
+		// Assigning to the existing parameters doesn't allocate.
+		std::copy(params.begin(), params.end(), fitted.begin());
+
+		detection::gaussian::fit(fitted, blurred, fit_temp, 3);
+		keep(fitted);
+	});
+
+	const char *type = std::is_same_v<T, f32> ? "f32" : "f64";
+	const std::string scenario = contacts < 0 ? "palm" : fmt::format("{}", contacts);
+
+	// The throughput is given relative to the size of the heatmap.
+	const f64 bytes = casts::to<f64>(input.size()) * casts::to<f64>(sizeof(T));
+
+	for (const auto &[name, func] : algorithms) {
+		if (std::string {name}.find(filter) == std::string::npos)
+			continue;
+
+		const f64 ns = measure(duration, func);
+		const f64 throughput = bytes / ns * 1e3;
+
+		spdlog::info("{:<12} {:<4} {:<6} {:>3}x{:<3} {:>8} {:>12.1f} {:>10.1f}", name, type,
+			     size.name, size.rows, size.cols, scenario, ns, throughput);
+	}
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for measuring the contact detection algorithms in isolation."};
+
+	usize time {};
+	app.add_option("-t,--time", time)
+		->description("For how long every algorithm is measured per case (in ms).")
+		->check(CLI::PositiveNumber)
+		->default_val(20)
+		->type_name("MS");
+
+	std::string filter {};
+	app.add_option("-f,--filter", filter)
+		->description("Only measure algorithms whose name contains this string.")
+		->type_name("NAME");
+
+	CLI11_PARSE(app, argc, argv);
+
+	const chrono::milliseconds duration {time};
+
+	spdlog::info("{:<12} {:<4} {:<6} {:>7} {:>8} {:>12} {:>10}", "algorithm", "type", "size",
+		     "", "contacts", "ns per call", "MB/s");
+
+	for (const Size &size : SIZES) {
+		for (const int contacts : CONTACTS) {
+			run_case<f32>(size, contacts, duration, filter);
+			run_case<f64>(size, contacts, duration, filter);
+		}
+	}
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::perf::algorithms
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::perf::algorithms::run(argc, argv);
+	} catch (std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_PERF_BASELINE_HPP
+#define IPTSD_APPS_PERF_BASELINE_HPP
+
+#include <common/casts.hpp>
+#include <common/histogram.hpp>
+#include <common/types.hpp>
+
+#include <fmt/format.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::perf::baseline {
+
+// The first line of a file with saved results, to detect files of other tools or versions.
+inline const std::string HEADER = "# iptsd-perf results v1";
+
+/*
+ * A distribution of durations (in nanoseconds) that can be saved and compared.
+ */
+struct Distribution {
+	std::string name;
+
+	// How many durations were recorded.
+	u64 count = 0;
+
+	// The sum of all durations.
+	u64 sum = 0;
+
+	// The upper bound of every non-empty bucket and how many durations fall into it.
+	std::vector<std::pair<u64, u64>> buckets {};
+
+	/*!
+	 * Copies the contents of a histogram.
+	 *
+	 * @param[in] name The name of the distribution.
+	 * @param[in] histogram The recorded durations.
+	 * @return The distribution of the durations.
+	 */
+	static Distribution from(const std::string &name, const Histogram &histogram)
+	{
+		return Distribution {name, histogram.count(), histogram.sum(), histogram.buckets()};
+	}
+
+	/*!
+	 * The average duration, or 0 if nothing was recorded.
+	 */
+	[[nodiscard]] f64 mean() const
+	{
+		if (count == 0)
+			return 0;
+
+		return casts::to<f64>(sum) / casts::to<f64>(count);
+	}
+};
+
+/*
+ * The result of comparing a distribution against the one of a baseline.
+ */
+struct Comparison {
+	// The relative change of the mean (e.g. 0.1 if the new durations are 10% longer).
+	f64 delta = 0;
+
+	// The probability that a new duration is longer than a duration of the baseline.
+	f64 slower = 0.5;
+
+	// The probability of seeing a difference this large if there was no difference (two-sided).
+	f64 p = 1;
+};
+
+/*!
+ * Saves distributions to a file, so that later runs can be compared against them.
+ *
+ * Every distribution is one line of tab separated values: The name, the count, the sum
+ * and the buckets as pairs of upper bound and count.
+ *
+ * @param[in] path The file to write to.
+ * @param[in] distributions The distributions to save.
+ */
+inline void save(const std::filesystem::path &path, const std::vector<Distribution> &distributions)
+{
+	std::ofstream file {path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path.string()};
+
+	file << HEADER << "\n";
+
+	for (const Distribution &d : distributions) {
+		file << fmt::format("{}\t{}\t{}\t", d.name, d.count, d.sum);
+
+		for (usize i = 0; i < d.buckets.size(); i++) {
+			const auto &[upper, count] = d.buckets[i];
+			file << fmt::format("{}{}:{}", i > 0 ? " " : "", upper, count);
+		}
+
+		file << "\n";
+	}
+}
+
+/*!
+ * Loads distributions that were saved with @ref save.
+ *
+ * @param[in] path The file to read from.
+ * @return The saved distributions, by their name.
+ */
+inline std::map<std::string, Distribution> load(const std::filesystem::path &path)
+{
+	std::ifstream file {path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path.string()};
+
+	std::string line {};
+
+	if (!std::getline(file, line) || line != HEADER)
+		throw std::runtime_error {path.string() + " does not contain iptsd-perf results"};
+
+	std::map<std::string, Distribution> distributions {};
+
+	while (std::getline(file, line)) {
+		if (line.empty())
+			continue;
+
+		std::istringstream fields {line};
+		Distribution d {};
+
+		std::string count {};
+		std::string sum {};
+		std::string buckets {};
+
+		std::getline(fields, d.name, '\t');
+		std::getline(fields, count, '\t');
+		std::getline(fields, sum, '\t');
+		std::getline(fields, buckets, '\t');
+
+		try {
+			d.count = std::stoull(count);
+			d.sum = std::stoull(sum);
+
+			std::istringstream pairs {buckets};
+			std::string pair {};
+
+			while (pairs >> pair) {
+				const usize colon = pair.find(':');
+
+				if (colon == std::string::npos)
+					throw std::invalid_argument {pair};
+
+				d.buckets.emplace_back(std::stoull(pair.substr(0, colon)),
+						       std::stoull(pair.substr(colon + 1)));
+			}
+		} catch (std::logic_error & /* unused */) {
+			throw std::runtime_error {"Malformed line in " + path.string()};
+		}
+
+		distributions.emplace(d.name, std::move(d));
+	}
+
+	return distributions;
+}
+
+/*!
+ * Compares new durations against the ones of a baseline, using a Mann-Whitney U test.
+ *
+ * The test only looks at the order of the durations, so a few outliers (e.g. from the
+ * scheduler) don't make the difference look larger or smaller than it is. Durations that
+ * fall into the same bucket of the histogram count as ties, which makes the test slightly
+ * more conservative. For the large amount of samples that a run creates, the normal
+ * approximation of U (with tie correction) is used.
+ *
+ * @param[in] baseline The durations of the baseline.
+ * @param[in] current The new durations.
+ * @return How much and how significantly the durations changed.
+ */
+inline Comparison compare(const Distribution &baseline, const Distribution &current)
+{
+	Comparison comparison {};
+
+	if (baseline.count == 0 || current.count == 0)
+		return comparison;
+
+	comparison.delta = current.mean() / baseline.mean() - 1;
+
+	// The bucket bounds of both distributions, merged into ascending order.
+	std::map<u64, std::pair<u64, u64>> merged {};
+
+	for (const auto &[upper, count] : baseline.buckets)
+		merged[upper].first += count;
+
+	for (const auto &[upper, count] : current.buckets)
+		merged[upper].second += count;
+
+	const auto n1 = casts::to<f64>(current.count);
+	const auto n2 = casts::to<f64>(baseline.count);
+	const f64 n = n1 + n2;
+
+	// How many new durations are larger than a duration of the baseline, ties count half.
+	f64 u = 0;
+
+	// For the correction of the variance, sum(t^3 - t) over all groups of ties.
+	f64 ties = 0;
+
+	f64 below = 0;
+
+	for (const auto &[upper, counts] : merged) {
+		const auto old = casts::to<f64>(counts.first);
+		const auto now = casts::to<f64>(counts.second);
+		const f64 t = old + now;
+
+		u += now * (below + old / 2);
+		ties += t * t * t - t;
+		below += old;
+	}
+
+	comparison.slower = u / (n1 * n2);
+
+	const f64 mean = n1 * n2 / 2;
+	const f64 variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+
+	// All durations are in the same bucket, there is no way to tell them apart.
+	if (variance <= 0)
+		return comparison;
+
+	const f64 z = (u - mean) / std::sqrt(variance);
+	comparison.p = std::erfc(std::abs(z) / std::sqrt(2.0));
+
+	return comparison;
+}
+
+} // namespace iptsd::apps::perf::baseline
+
+#endif // IPTSD_APPS_PERF_BASELINE_HPP
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "golden.hpp"
+
+#include <common/types.hpp>
+#include <core/linux/file-runner.hpp>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace iptsd::apps::perf::golden {
+namespace {
+
+/*!
+ * Runs the contact detection over a capture and collects the contacts of every frame.
+ *
+ * @param[in] path The capture file.
+ * @return The contacts of every frame.
+ */
+std::vector<Frame> detect(const std::filesystem::path &path)
+{
+	core::linux::FileRunner<Recorder> runner {path};
+	runner.run();
+
+	return runner.application().frames;
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for checking that the contact detection produces the same contacts "
+		      "as a reference build."};
+
+	std::filesystem::path golden {};
+	app.add_option("GOLDEN", golden)
+		->description("The file with the contacts of the reference build.")
+		->type_name("FILE")
+		->required();
+
+	std::vector<std::filesystem::path> captures {};
+	app.add_option("DATA", captures)
+		->description("Captures of real or synthetic (iptsd-perf-synthesize) touch data.")
+		->type_name("FILE")
+		->check(CLI::ExistingFile)
+		->required();
+
+	bool record = false;
+	app.add_flag("-r,--record", record)
+		->description("Write the contacts of this build to GOLDEN instead of checking.");
+
+	Tolerances tolerances {};
+
+	app.add_option("--position", tolerances.position)
+		->description("How much the position of a contact may differ.")
+		->default_val(tolerances.position);
+
+	app.add_option("--size", tolerances.size)
+		->description("How much the size of a contact may differ.")
+		->default_val(tolerances.size);
+
+	app.add_option("--orientation", tolerances.orientation)
+		->description("How much the orientation of a contact may differ.")
+		->default_val(tolerances.orientation);
+
+	CLI11_PARSE(app, argc, argv);
+
+	if (record) {
+		std::ofstream file {golden};
+		if (!file)
+			throw std::runtime_error {"Failed to open " + golden.string()};
+
+		file << HEADER << "\n";
+
+		for (const std::filesystem::path &capture : captures) {
+			const std::vector<Frame> frames = detect(capture);
+			write(file, capture.filename().string(), frames);
+
+			spdlog::info("{}: Recorded {} frames", capture.filename().string(),
+				     frames.size());
+		}
+
+		return 0;
+	}
+
+	const std::map<std::string, std::vector<Frame>> expected = read(golden);
+	bool diverged = false;
+
+	for (const std::filesystem::path &capture : captures) {
+		const std::string name = capture.filename().string();
+		const auto it = expected.find(name);
+
+		if (it == expected.end()) {
+			spdlog::error("{}: Not part of {}", name, golden.string());
+
+			diverged = true;
+			continue;
+		}
+
+		Deviation max {};
+
+		const std::vector<Frame> actual = detect(capture);
+		const std::optional<Divergence> divergence =
+			compare(it->second, actual, tolerances, max);
+
+		if (divergence.has_value()) {
+			spdlog::error("{}: Diverged at frame {}: {}", name, divergence->frame,
+				      divergence->reason);
+
+			diverged = true;
+		} else {
+			spdlog::info("{}: {} frames match", name, actual.size());
+		}
+
+		spdlog::info("{}: Largest deviation: position {:.3e}, size {:.3e}, "
+			     "orientation {:.3e}",
+			     name, max.position, max.size, max.orientation);
+	}
+
+	if (diverged)
+		return EXIT_FAILURE;
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::perf::golden
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::perf::golden::run(argc, argv);
+	} catch (std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_PERF_GOLDEN_HPP
+#define IPTSD_APPS_PERF_GOLDEN_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <contacts/contact.hpp>
+#include <core/generic/application.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace iptsd::apps::perf::golden {
+
+// The first line of a file with golden output, to detect files of other tools or versions.
+inline const std::string HEADER = "# iptsd-perf golden v1";
+
+// The contacts that were found in one heatmap.
+using Frame = std::vector<contacts::Contact<f64>>;
+
+/*
+ * How much the contacts of a candidate may differ from the golden output.
+ *
+ * The values are absolute, in the units of the contacts (normalized to [0, 1] by default).
+ * Index, stability and validity always have to match exactly.
+ */
+struct Tolerances {
+	f64 position = 1e-4;
+	f64 size = 1e-4;
+	f64 orientation = 1e-4;
+};
+
+/*
+ * The largest difference between the golden output and the candidate that was seen.
+ */
+struct Deviation {
+	f64 position = 0;
+	f64 size = 0;
+	f64 orientation = 0;
+};
+
+/*
+ * The first place where the candidate differs from the golden output.
+ */
+struct Divergence {
+	usize frame;
+	std::string reason;
+};
+
+/*
+ * Collects the contacts of every frame that is processed.
+ */
+class Recorder : public core::Application {
+public:
+	std::vector<Frame> frames {};
+
+public:
+	Recorder(const core::Config &config,
+		 const core::DeviceInfo &info,
+		 std::optional<const ipts::Metadata> metadata)
+		: core::Application(config, info, metadata) {};
+
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
+	{
+		frames.push_back(contacts);
+	}
+};
+
+namespace impl {
+
+/*!
+ * Formats an optional value for the golden file, with -1 meaning that it is not set.
+ */
+template <class T>
+std::string optional(const std::optional<T> &value)
+{
+	if (!value.has_value())
+		return "-1";
+
+	return fmt::format("{}", casts::to<i64>(value.value()));
+}
+
+/*!
+ * The difference between two values, treating two NaNs as equal.
+ */
+inline f64 distance(const f64 a, const f64 b)
+{
+	if (std::isnan(a) && std::isnan(b))
+		return 0;
+
+	if (std::isnan(a) || std::isnan(b))
+		return std::numeric_limits<f64>::infinity();
+
+	return std::abs(a - b);
+}
+
+/*!
+ * The difference between two orientations, which wrap around after half a turn.
+ */
+inline f64 angle(const f64 a, const f64 b, const bool normalized)
+{
+	const f64 period = normalized ? 1.0 : M_PI;
+	const f64 d = std::fmod(impl::distance(a, b), period);
+
+	return std::min(d, period - d);
+}
+
+/*!
+ * Compares a single contact against the golden output.
+ *
+ * @param[in] expected The golden contact.
+ * @param[in] actual The contact of the candidate.
+ * @param[in] tolerances How much the values may differ.
+ * @param[in,out] max The largest deviation that was seen so far.
+ * @return A description of the difference, or nothing if the contacts match.
+ */
+inline std::optional<std::string> compare(const contacts::Contact<f64> &expected,
+					  const contacts::Contact<f64> &actual,
+					  const Tolerances &tolerances,
+					  Deviation &max)
+{
+	if (expected.index != actual.index)
+		return "index changed";
+
+	if (expected.stable != actual.stable)
+		return "stability changed";
+
+	if (expected.valid != actual.valid)
+		return "validity changed";
+
+	const f64 position = std::max(impl::distance(expected.mean.x(), actual.mean.x()),
+				      impl::distance(expected.mean.y(), actual.mean.y()));
+
+	const f64 size = std::max(impl::distance(expected.size.x(), actual.size.x()),
+				  impl::distance(expected.size.y(), actual.size.y()));
+
+	const f64 orientation =
+		impl::angle(expected.orientation, actual.orientation, expected.normalized);
+
+	max.position = std::max(max.position, position);
+	max.size = std::max(max.size, size);
+	max.orientation = std::max(max.orientation, orientation);
+
+	if (position > tolerances.position) {
+		return fmt::format("mean ({:.6f}, {:.6f}) became ({:.6f}, {:.6f})",
+				   expected.mean.x(), expected.mean.y(), actual.mean.x(),
+				   actual.mean.y());
+	}
+
+	if (size > tolerances.size) {
+		return fmt::format("size ({:.6f}, {:.6f}) became ({:.6f}, {:.6f})",
+				   expected.size.x(), expected.size.y(), actual.size.x(),
+				   actual.size.y());
+	}
+
+	if (orientation > tolerances.orientation) {
+		return fmt::format("orientation {:.6f} became {:.6f}", expected.orientation,
+				   actual.orientation);
+	}
+
+	return std::nullopt;
+}
+
+} // namespace impl
+
+/*!
+ * Appends the contacts of a capture to a golden file.
+ *
+ * Every frame is one line with the amount of contacts, followed by the index, mean, size,
+ * orientation, stability and validity of every contact. The values are written with full
+ * precision, so that an unchanged implementation reproduces them exactly.
+ *
+ * @param[in] file The golden file.
+ * @param[in] name The name of the capture that the contacts were found in.
+ * @param[in] frames The contacts of every frame.
+ */
+inline void write(std::ofstream &file, const std::string &name, const std::vector<Frame> &frames)
+{
+	file << fmt::format("capture\t{}\t{}\n", name, frames.size());
+
+	for (const Frame &frame : frames) {
+		file << frame.size();
+
+		for (const contacts::Contact<f64> &c : frame) {
+			file << fmt::format(" {} {} {} {} {} {} {} {} {}", impl::optional(c.index),
+					    c.mean.x(), c.mean.y(), c.size.x(), c.size.y(),
+					    c.orientation, c.normalized ? 1 : 0,
+					    impl::optional(c.stable), impl::optional(c.valid));
+		}
+
+		file << "\n";
+	}
+}
+
+/*!
+ * Loads all captures from a golden file.
+ *
+ * @param[in] path The golden file.
+ * @return The contacts of every frame, by the name of their capture.
+ */
+inline std::map<std::string, std::vector<Frame>> read(const std::filesystem::path &path)
+{
+	std::ifstream file {path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path.string()};
+
+	std::string line {};
+
+	if (!std::getline(file, line) || line != HEADER)
+		throw std::runtime_error {path.string() + " does not contain golden output"};
+
+	std::map<std::string, std::vector<Frame>> captures {};
+	std::vector<Frame> *frames = nullptr;
+
+	// Reads a value as a string first, because streams can't parse NaN.
+	const auto next = [&](std::istringstream &values) {
+		std::string value {};
+
+		if (!(values >> value))
+			throw std::invalid_argument {"Missing value"};
+
+		return value;
+	};
+
+	const auto flag = [](const i64 value) -> std::optional<bool> {
+		if (value < 0)
+			return std::nullopt;
+
+		return value != 0;
+	};
+
+	try {
+		while (std::getline(file, line)) {
+			if (line.rfind("capture\t", 0) == 0) {
+				const usize end = line.find('\t', 8);
+				frames = &captures[line.substr(8, end - 8)];
+
+				continue;
+			}
+
+			if (frames == nullptr)
+				throw std::invalid_argument {"Frame without capture"};
+
+			std::istringstream values {line};
+			Frame &frame = frames->emplace_back();
+
+			const usize count = std::stoull(next(values));
+
+			for (usize i = 0; i < count; i++) {
+				contacts::Contact<f64> &c = frame.emplace_back();
+
+				const i64 index = std::stoll(next(values));
+				if (index >= 0)
+					c.index = casts::to<usize>(index);
+
+				c.mean.x() = std::stod(next(values));
+				c.mean.y() = std::stod(next(values));
+				c.size.x() = std::stod(next(values));
+				c.size.y() = std::stod(next(values));
+				c.orientation = std::stod(next(values));
+				c.normalized = std::stoll(next(values)) != 0;
+				c.stable = flag(std::stoll(next(values)));
+				c.valid = flag(std::stoll(next(values)));
+			}
+		}
+	} catch (std::logic_error &e) {
+		const std::string reason = e.what();
+		throw std::runtime_error {"Malformed golden file " + path.string() + ": " + reason};
+	}
+
+	return captures;
+}
+
+/*!
+ * Compares the contacts of a candidate against the golden output, frame by frame.
+ *
+ * @param[in] expected The contacts of every frame in the golden output.
+ * @param[in] actual The contacts of every frame that the candidate found.
+ * @param[in] tolerances How much the values of a contact may differ.
+ * @param[out] max The largest deviation of every value, up to the first divergence.
+ * @return The first frame that differs, or nothing if all frames match.
+ */
+inline std::optional<Divergence> compare(const std::vector<Frame> &expected,
+					 const std::vector<Frame> &actual,
+					 const Tolerances &tolerances,
+					 Deviation &max)
+{
+	max = Deviation {};
+
+	const usize frames = std::min(expected.size(), actual.size());
+
+	for (usize i = 0; i < frames; i++) {
+		const Frame &a = expected[i];
+		const Frame &b = actual[i];
+
+		if (a.size() != b.size()) {
+			const std::string reason =
+				fmt::format("expected {} contacts, found {}", a.size(), b.size());
+
+			return Divergence {i, reason};
+		}
+
+		for (usize j = 0; j < a.size(); j++) {
+			const std::optional<std::string> reason =
+				impl::compare(a[j], b[j], tolerances, max);
+
+			if (reason.has_value())
+				return Divergence {i, fmt::format("contact {}: {}", j, *reason)};
+		}
+	}
+
+	if (expected.size() != actual.size()) {
+		return Divergence {frames, fmt::format("expected {} frames, found {}",
+						       expected.size(), actual.size())};
+	}
+
+	return std::nullopt;
+}
+
+} // namespace iptsd::apps::perf::golden
+
+#endif // IPTSD_APPS_PERF_GOLDEN_HPP
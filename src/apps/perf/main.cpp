@@ -1,14 +1,20 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include "baseline.hpp"
 #include "perf.hpp"
 
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/histogram.hpp>
+#include <common/latency.hpp>
+#include <common/trace.hpp>
 #include <common/types.hpp>
 #include <core/linux/file-runner.hpp>
+#include <core/linux/perf-counters.hpp>
 #include <core/linux/signal-handler.hpp>
 
 #include <CLI/CLI.hpp>
+#include <fmt/format.h>
 #include <gsl/gsl>
 #include <spdlog/spdlog.h>
 
@@ -17,12 +23,371 @@
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <future>
+#include <memory>
+#include <optional>
 #include <ratio>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace iptsd::apps::perf {
 namespace {
 
+/*
+ * A distribution of durations that is part of the results.
+ */
+struct Row {
+	std::string name;
+	const Histogram &histogram;
+};
+
+/*!
+ * A readable name for a bucket of contact counts, like "3-4" or "10+".
+ *
+ * @param[in] index The index of the bucket.
+ * @return The range of contact counts that fall into the bucket.
+ */
+std::string bucket_name(const usize index)
+{
+	const usize lower = gsl::at(Perf::CONTACT_BUCKETS, index);
+
+	if (index + 1 == Perf::CONTACT_BUCKETS.size())
+		return fmt::format("{}+", lower);
+
+	const usize upper = gsl::at(Perf::CONTACT_BUCKETS, index + 1) - 1;
+
+	if (lower == upper)
+		return fmt::format("{}", lower);
+
+	return fmt::format("{}-{}", lower, upper);
+}
+
+/*!
+ * Collects all distributions that contain data.
+ *
+ * @param[in] app The application that processed the data.
+ * @return The total processing time, the time of every stage and by the amount of contacts.
+ */
+std::vector<Row> collect(const Perf &app)
+{
+	std::vector<Row> rows {};
+	rows.push_back(Row {"total", app.total});
+
+	for (usize i = 0; i < static_cast<usize>(latency::Stage::Count); i++) {
+		const auto stage = static_cast<latency::Stage>(i);
+		const Histogram &histogram = latency::histogram(stage);
+
+		if (histogram.count() > 0)
+			rows.push_back(Row {latency::name(stage), histogram});
+	}
+
+	for (usize i = 0; i < app.by_contacts.size(); i++) {
+		const Histogram &histogram = gsl::at(app.by_contacts, i);
+
+		if (histogram.count() > 0)
+			rows.push_back(Row {"contacts " + bucket_name(i), histogram});
+	}
+
+	return rows;
+}
+
+/*!
+ * Writes the distributions to a file as JSON, so that they can be compared by other tools.
+ *
+ * All durations are given in microseconds.
+ *
+ * @param[in] path The file to write to.
+ * @param[in] rows The distributions to write.
+ */
+void write_json(const std::filesystem::path &path, const std::vector<Row> &rows)
+{
+	std::ofstream file {path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path.string()};
+
+	const auto us = [](const f64 ns) { return ns / 1e3; };
+
+	file << "{\n";
+
+	for (usize i = 0; i < rows.size(); i++) {
+		const Histogram &h = rows[i].histogram;
+
+		file << fmt::format(R"(  "{}": {{"count": {}, "mean": {:.3f}, "p50": {:.3f}, )",
+				    rows[i].name, h.count(), us(h.mean()),
+				    us(casts::to<f64>(h.percentile(0.5))));
+
+		file << fmt::format(R"("p90": {:.3f}, "p99": {:.3f}, )",
+				    us(casts::to<f64>(h.percentile(0.9))),
+				    us(casts::to<f64>(h.percentile(0.99))));
+
+		file << fmt::format(R"("p99.9": {:.3f}, "max": {:.3f}}})",
+				    us(casts::to<f64>(h.percentile(0.999))),
+				    us(casts::to<f64>(h.max())));
+
+		file << (i + 1 < rows.size() ? ",\n" : "\n");
+	}
+
+	file << "}\n";
+}
+
+/*!
+ * Compares the distributions of this run against the ones of a baseline and prints the verdict.
+ *
+ * A row is a regression if its mean got slower by more than the threshold,
+ * and the difference is statistically significant.
+ *
+ * @param[in] saved The distributions of the baseline, by their name.
+ * @param[in] rows The distributions of this run.
+ * @param[in] threshold How much slower a row may get before it is a regression (e.g. 0.05).
+ * @return Whether any row regressed.
+ */
+bool compare_baseline(const std::map<std::string, baseline::Distribution> &saved,
+		      const std::vector<Row> &rows,
+		      const f64 threshold)
+{
+	// With thousands of samples, even tiny differences are significant. The threshold
+	// decides whether they matter, this only rules out noise.
+	constexpr f64 significance = 0.001;
+
+	spdlog::info("{:<12} {:>9} {:>9} {:>8} {:>8} {:>9}  {}", "(in μs)", "baseline", "mean",
+		     "delta", "P(slow)", "p-value", "verdict");
+
+	bool regressed = false;
+
+	for (const Row &row : rows) {
+		const auto it = saved.find(row.name);
+
+		if (it == saved.end()) {
+			spdlog::info("{:<12} {:>9} {:>9.2f} {:>8} {:>8} {:>9}  {}", row.name, "-",
+				     row.histogram.mean() / 1e3, "-", "-", "-", "new");
+			continue;
+		}
+
+		const baseline::Distribution &old = it->second;
+		const auto current = baseline::Distribution::from(row.name, row.histogram);
+		const baseline::Comparison c = baseline::compare(old, current);
+
+		const char *verdict = "same";
+
+		if (c.p < significance && c.delta > threshold) {
+			verdict = "SLOWER";
+			regressed = true;
+		} else if (c.p < significance && c.delta < -threshold) {
+			verdict = "faster";
+		}
+
+		spdlog::info("{:<12} {:>9.2f} {:>9.2f} {:>+7.1f}% {:>8.2f} {:>9.1e}  {}", row.name,
+			     old.mean() / 1e3, current.mean() / 1e3, c.delta * 100, c.slower, c.p,
+			     verdict);
+	}
+
+	return regressed;
+}
+
+/*!
+ * Prints the hardware events that were counted per stage, averaged over all runs of a stage.
+ *
+ * @param[in] counters The counters that observed the pipeline.
+ */
+void print_counters(const core::linux::PerfCounters &counters)
+{
+	using Event = core::linux::PerfCounters::Event;
+
+	spdlog::info("{:<12} {:>8} {:>12} {:>12} {:>6} {:>10} {:>10} {:>10}", "(mean)", "count",
+		     "cycles", "instructions", "IPC", "L1 misses", "LLC misses", "br misses");
+
+	for (usize i = 0; i < core::linux::PerfCounters::STAGES; i++) {
+		const auto stage = static_cast<latency::Stage>(i);
+		const u64 laps = counters.laps(stage);
+
+		if (laps == 0)
+			continue;
+
+		const auto mean = [&](const Event event) {
+			return casts::to<f64>(counters.total(stage, event)) / casts::to<f64>(laps);
+		};
+
+		const auto format = [&](const Event event) -> std::string {
+			if (!counters.available(event))
+				return "-";
+
+			return fmt::format("{:.0f}", mean(event));
+		};
+
+		std::string ipc = "-";
+
+		if (counters.available(Event::Cycles) && counters.available(Event::Instructions)) {
+			const f64 cycles = mean(Event::Cycles);
+
+			if (cycles > 0)
+				ipc = fmt::format("{:.2f}", mean(Event::Instructions) / cycles);
+		}
+
+		spdlog::info("{:<12} {:>8} {:>12} {:>12} {:>6} {:>10} {:>10} {:>10}",
+			     latency::name(stage), laps, format(Event::Cycles),
+			     format(Event::Instructions), ipc, format(Event::L1Misses),
+			     format(Event::LlcMisses), format(Event::BranchMisses));
+	}
+
+	if (counters.multiplexed())
+		spdlog::warn("The counters were multiplexed with other events, values are too low");
+}
+
+/*
+ * The throughput and latency of a certain amount of pipelines that run at the same time.
+ */
+struct Scaling {
+	usize threads = 0;
+
+	// How many heatmaps were processed by all pipelines together.
+	u64 frames = 0;
+
+	// How long it took until all pipelines were done.
+	f64 seconds = 0;
+
+	// The median processing time, averaged over all pipelines (in microseconds).
+	f64 p50 = 0;
+
+	// The 99th percentile of the processing time, of the slowest pipeline (in microseconds).
+	f64 p99 = 0;
+};
+
+/*!
+ * Processes captures with multiple independent pipelines, each one on its own thread.
+ *
+ * Every pipeline has its own reader and contact finder, so the only state that they share
+ * is what is shared by the code itself (e.g. global variables or the allocator). The latency
+ * histograms of the stages are shared by all threads, so the pipelines don't record them.
+ *
+ * @param[in] paths The captures to process. Pipeline i processes capture i % paths.size().
+ * @param[in] threads How many pipelines run at the same time.
+ * @param[in] runs How many times every pipeline processes its capture.
+ * @return The combined throughput and the latency of the pipelines.
+ */
+Scaling scale(const std::vector<std::filesystem::path> &paths,
+	      const usize threads,
+	      const usize runs)
+{
+	std::vector<std::unique_ptr<core::linux::FileRunner<Perf>>> runners {};
+
+	// Every runner logs the device it was created for, once is enough.
+	spdlog::set_level(spdlog::level::warn);
+
+	for (usize i = 0; i < threads; i++) {
+		const std::filesystem::path &path = paths[i % paths.size()];
+		runners.push_back(std::make_unique<core::linux::FileRunner<Perf>>(path));
+	}
+
+	spdlog::set_level(spdlog::level::info);
+
+	const auto stop = [&](int) {
+		for (const auto &runner : runners)
+			runner->stop();
+	};
+
+	const auto _sigterm = core::linux::signal<SIGTERM>(stop);
+	const auto _sigint = core::linux::signal<SIGINT>(stop);
+
+	// Create all threads first, so that the pipelines start processing at the same time.
+	std::promise<void> start {};
+	const std::shared_future<void> started = start.get_future().share();
+
+	std::vector<std::thread> workers {};
+
+	for (const auto &runner : runners) {
+		workers.emplace_back([&runner, started, runs]() {
+			// Recording the stages would make the pipelines compete for the histograms.
+			latency::enable(false);
+
+			started.wait();
+
+			for (usize i = 0; i < runs; i++) {
+				if (runner->run())
+					break;
+
+				runner->application().reset();
+			}
+		});
+	}
+
+	const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+	start.set_value();
+
+	for (std::thread &worker : workers)
+		worker.join();
+
+	const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+	Scaling result {};
+	result.threads = threads;
+	result.seconds = chrono::duration_cast<seconds<f64>>(end - begin).count();
+
+	for (const auto &runner : runners) {
+		const Histogram &total = runner->application().total;
+
+		const f64 p50 = casts::to<f64>(total.percentile(0.5)) / 1e3;
+		const f64 p99 = casts::to<f64>(total.percentile(0.99)) / 1e3;
+
+		result.frames += total.count();
+		result.p50 += p50 / casts::to<f64>(threads);
+		result.p99 = std::max(result.p99, p99);
+	}
+
+	return result;
+}
+
+/*!
+ * Measures how the throughput changes as more pipelines run at the same time.
+ *
+ * The amount of threads is doubled until the maximum is reached.
+ *
+ * @param[in] paths The captures to process.
+ * @param[in] threads The largest amount of pipelines that run at the same time.
+ * @param[in] runs How many times every pipeline processes its capture.
+ */
+void run_scaling(const std::vector<std::filesystem::path> &paths,
+		 const usize threads,
+		 const usize runs)
+{
+	const usize cpus = std::thread::hardware_concurrency();
+
+	if (cpus > 0 && threads > cpus)
+		spdlog::warn("Running {} threads on {} CPUs, they will compete", threads, cpus);
+
+	std::vector<usize> counts {};
+
+	for (usize n = 1; n < threads; n *= 2)
+		counts.push_back(n);
+
+	counts.push_back(threads);
+
+	std::vector<Scaling> results {};
+
+	for (const usize n : counts) {
+		results.push_back(scale(paths, n, runs));
+		spdlog::info("Measured {} threads", n);
+	}
+
+	const f64 base = casts::to<f64>(results.front().frames) / results.front().seconds;
+
+	spdlog::info("{:>8} {:>10} {:>12} {:>8} {:>10} {:>9} {:>9}", "threads", "frames",
+		     "frames/s", "speedup", "efficiency", "p50 (μs)", "p99 (μs)");
+
+	for (const Scaling &result : results) {
+		const f64 throughput = casts::to<f64>(result.frames) / result.seconds;
+		const f64 speedup = throughput / base;
+		const f64 efficiency = speedup / casts::to<f64>(result.threads);
+
+		spdlog::info("{:>8} {:>10} {:>12.0f} {:>8.2f} {:>9.0f}% {:>9.2f} {:>9.2f}",
+			     result.threads, result.frames, throughput, speedup,
+			     efficiency * 100, result.p50, result.p99);
+	}
+}
+
 int run(const int argc, const char **argv)
 {
 	CLI::App app {"Utility for performance testing of iptsd."};
@@ -39,55 +404,169 @@ int run(const int argc, const char **argv)
 		->check(CLI::PositiveNumber)
 		->default_val(10);
 
+	std::filesystem::path trace {};
+	CLI::Option *trace_opt =
+		app.add_option("--trace", trace)
+			->description("Write a trace of the last processed reports to this file.")
+			->type_name("FILE");
+
+	std::filesystem::path json {};
+	CLI::Option *json_opt =
+		app.add_option("--json", json)
+			->description("Write the results to this file as JSON (in microseconds).")
+			->type_name("FILE");
+
+	usize threads {};
+	CLI::Option *threads_opt =
+		app.add_option("--threads", threads)
+			->description("Measure the throughput of up to N pipelines on N threads.")
+			->check(CLI::PositiveNumber)
+			->type_name("N");
+
+	std::vector<std::filesystem::path> captures {};
+	app.add_option("--capture", captures)
+		->description("More captures that are distributed over the threads.")
+		->type_name("FILE")
+		->needs(threads_opt);
+
+	std::filesystem::path save {};
+	CLI::Option *save_opt =
+		app.add_option("--save", save)
+			->description("Save the results to this file, to compare other runs to it.")
+			->type_name("FILE")
+			->excludes(threads_opt);
+
+	std::filesystem::path base {};
+	CLI::Option *base_opt =
+		app.add_option("--baseline", base)
+			->description("Compare the results against a file created with --save.")
+			->type_name("FILE")
+			->excludes(threads_opt);
+
+	f64 threshold {};
+	app.add_option("--threshold", threshold)
+		->description("How much slower (in percent) a stage may get before the comparison "
+			      "fails.")
+		->check(CLI::NonNegativeNumber)
+		->default_val(5)
+		->needs(base_opt);
+
+	bool count_events = false;
+	app.add_flag("--counters", count_events)
+		->description("Count hardware events (cycles, cache misses, ...) for every stage.")
+		->excludes(threads_opt);
+
 	CLI11_PARSE(app, argc, argv);
 
+	if (threads_opt->count() > 0) {
+		captures.insert(captures.begin(), path);
+		run_scaling(captures, threads, runs);
+
+		return 0;
+	}
+
+	if (trace_opt->count() > 0 && !trace::ENABLED)
+		spdlog::warn("Tracing was disabled at compile time, traces will be empty");
+
+	// Load the baseline first, so that a broken file doesn't waste a long run.
+	std::map<std::string, baseline::Distribution> saved {};
+
+	if (base_opt->count() > 0)
+		saved = baseline::load(base);
+
 	// Create a performance testing application that reads from a file.
 	core::linux::FileRunner<Perf> perf {path};
 
 	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { perf.stop(); });
 	const auto _sigint = core::linux::signal<SIGINT>([&](int) { perf.stop(); });
 
-	using clock = std::chrono::steady_clock;
+	// The counters only observe the thread that opened them, which is the one running perf.
+	std::optional<core::linux::PerfCounters> counters = std::nullopt;
 
-	usize total = 0;
-	usize total_of_squares = 0;
-	usize count = 0;
+	if (count_events) {
+		counters.emplace();
 
-	clock::duration min = clock::duration::max();
-	clock::duration max = clock::duration::min();
+		if (counters->available())
+			latency::observe(&counters.value());
+	}
 
 	bool should_stop = false;
 
 	for (usize i = 0; i < runs; i++) {
 		should_stop = perf.run();
 
-		Perf &app = perf.application();
-
-		total += app.total;
-		total_of_squares += app.total_of_squares;
-		count += app.count;
-
-		min = std::min(min, app.min);
-		max = std::max(max, app.max);
-
 		if (should_stop)
 			break;
 
-		app.reset();
+		perf.application().reset();
 	}
 
-	const f64 n = casts::to<f64>(count);
-	const f64 mean = casts::to<f64>(total) / n;
-	const f64 stddev = std::sqrt(casts::to<f64>(total_of_squares) / n - mean * mean);
+	latency::observe(nullptr);
+
+	const Perf &results = perf.application();
+
+	const f64 n = casts::to<f64>(results.total.count());
+	const f64 mean = results.total.mean() / 1e3;
+	const f64 stddev = std::sqrt(results.sum_of_squares / n - mean * mean);
 
-	spdlog::info("Ran {} times", count);
-	spdlog::info("Total: {}μs", total);
+	spdlog::info("Ran {} times", results.total.count());
+	spdlog::info("Total: {:.0f}μs", mean * n);
 	spdlog::info("Mean: {:.2f}μs", mean);
 	spdlog::info("Standard Deviation: {:.2f}μs", stddev);
-	spdlog::info("Minimum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(min).count());
-	spdlog::info("Maximum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(max).count());
+	spdlog::info("Minimum: {:.3f}μs",
+		     chrono::duration_cast<microseconds<f64>>(results.min).count());
+	spdlog::info("Maximum: {:.3f}μs",
+		     chrono::duration_cast<microseconds<f64>>(results.max).count());
+
+	const std::vector<Row> rows = collect(results);
+
+	spdlog::info("{:<12} {:>8} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9}", "(in μs)", "count",
+		     "mean", "p50", "p90", "p99", "p99.9", "max");
+
+	for (const Row &row : rows) {
+		const Histogram &h = row.histogram;
+		const auto us = [](const u64 ns) { return casts::to<f64>(ns) / 1e3; };
+
+		spdlog::info("{:<12} {:>8} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f}",
+			     row.name, h.count(), h.mean() / 1e3, us(h.percentile(0.5)),
+			     us(h.percentile(0.9)), us(h.percentile(0.99)),
+			     us(h.percentile(0.999)), us(h.max()));
+	}
+
+	if (counters.has_value() && counters->available())
+		print_counters(counters.value());
+
+	if (json_opt->count() > 0) {
+		write_json(json, rows);
+		spdlog::info("Wrote results to {}", json.string());
+	}
+
+	if (trace_opt->count() > 0) {
+		trace::write(trace);
+		spdlog::info("Wrote trace to {}", trace.string());
+	}
+
+	if (save_opt->count() > 0) {
+		std::vector<baseline::Distribution> distributions {};
+
+		for (const Row &row : rows) {
+			const std::string &name = row.name;
+			distributions.push_back(baseline::Distribution::from(name, row.histogram));
+		}
+
+		baseline::save(save, distributions);
+		spdlog::info("Saved results to {}", save.string());
+	}
+
+	if (base_opt->count() > 0) {
+		spdlog::info("Comparing against {}", base.string());
+
+		if (compare_baseline(saved, rows, threshold / 100))
+			return EXIT_FAILURE;
+	}
 
-	if (!should_stop)
+	// The runs were interrupted, so the results are incomplete.
+	if (should_stop)
 		return EXIT_FAILURE;
 
 	return 0;
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/types.hpp>
+#include <core/linux/capture-reader.hpp>
+#include <ipts/data.hpp>
+#include <ipts/parser.hpp>
+
+#include <CLI/CLI.hpp>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace iptsd::apps::perf::parser {
+namespace {
+
+/*
+ * Collects a little bit of information from every parsed object,
+ * so that the compiler can't optimize the parsing away.
+ */
+struct Counter {
+	usize stylus = 0;
+	usize heatmaps = 0;
+	usize dft = 0;
+	usize bytes = 0;
+
+	void on_stylus(const ipts::StylusData &data)
+	{
+		stylus++;
+		bytes += data.serial;
+	}
+
+	void on_heatmap(const ipts::Heatmap &data)
+	{
+		heatmaps++;
+		bytes += data.data.size();
+	}
+
+	void on_dft(const ipts::DftWindow &data)
+	{
+		dft++;
+		bytes += data.rows;
+	}
+
+	void on_metadata(const ipts::Metadata & /* unused */) {};
+};
+
+/*
+ * Passes a reference to the counter into the parser.
+ */
+struct CounterSink {
+	Counter *counter;
+
+	void on_stylus(const ipts::StylusData &data) const
+	{
+		counter->on_stylus(data);
+	}
+
+	void on_heatmap(const ipts::Heatmap &data) const
+	{
+		counter->on_heatmap(data);
+	}
+
+	void on_dft(const ipts::DftWindow &data) const
+	{
+		counter->on_dft(data);
+	}
+
+	void on_metadata(const ipts::Metadata &data) const
+	{
+		counter->on_metadata(data);
+	}
+};
+
+/*!
+ * Parses all reports multiple times and measures how long that took.
+ *
+ * @param[in] reports The reports to parse.
+ * @param[in] runs How many times the reports will be parsed.
+ * @param[in] parse The function that parses a single report.
+ * @return The average time that was spent per report (in nanoseconds).
+ */
+template <class F>
+f64 measure(std::vector<std::vector<u8>> &reports, const usize runs, F &&parse)
+{
+	using clock = chrono::steady_clock;
+
+	const clock::time_point start = clock::now();
+
+	for (usize i = 0; i < runs; i++) {
+		for (std::vector<u8> &report : reports)
+			parse(report);
+	}
+
+	const clock::duration time = clock::now() - start;
+	const f64 total = chrono::duration_cast<nanoseconds<f64>>(time).count();
+
+	return total / casts::to<f64>(runs * reports.size());
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for measuring the overhead of dispatching parsed IPTS data."};
+
+	std::filesystem::path path {};
+	app.add_option("DATA", path)
+		->description("A binary data file containing touch reports.")
+		->type_name("FILE")
+		->required();
+
+	usize runs {};
+	app.add_option("RUNS", runs)
+		->description("How many times data will be parsed.")
+		->check(CLI::PositiveNumber)
+		->default_val(100);
+
+	CLI11_PARSE(app, argc, argv);
+
+	core::linux::CaptureReader capture {path};
+
+	// Load the reports into memory, reading the file should not be part of the measurement.
+	std::vector<std::vector<u8>> reports {};
+
+	while (true) {
+		const std::optional<core::linux::CaptureReader::Frame> frame = capture.next();
+		if (!frame.has_value())
+			break;
+
+		reports.emplace_back(frame->data.begin(), frame->data.end());
+	}
+
+	if (reports.empty())
+		throw std::runtime_error("The capture does not contain any reports!");
+
+	Counter callbacks {};
+	Counter sink {};
+
+	ipts::Parser dynamic {};
+	dynamic.on_stylus = [&](const auto &data) { callbacks.on_stylus(data); };
+	dynamic.on_heatmap = [&](const auto &data) { callbacks.on_heatmap(data); };
+	dynamic.on_dft = [&](const auto &data) { callbacks.on_dft(data); };
+	dynamic.on_metadata = [&](const auto &data) { callbacks.on_metadata(data); };
+
+	ipts::BasicParser<CounterSink> fixed {CounterSink {&sink}};
+
+	const auto parse_dynamic = [&](std::vector<u8> &report) {
+		try {
+			dynamic.parse(report);
+		} catch (std::exception &) {
+			// ignored
+		}
+	};
+
+	const auto parse_fixed = [&](std::vector<u8> &report) {
+		try {
+			fixed.parse(report);
+		} catch (std::exception &) {
+			// ignored
+		}
+	};
+
+	// Warm up the caches, so that the order of the measurements doesn't matter.
+	measure(reports, 1, parse_dynamic);
+	measure(reports, 1, parse_fixed);
+
+	callbacks = {};
+	sink = {};
+
+	const f64 time_dynamic = measure(reports, runs, parse_dynamic);
+	const f64 time_fixed = measure(reports, runs, parse_fixed);
+
+	if (callbacks.bytes != sink.bytes)
+		throw std::runtime_error("Both parsers should produce the same results!");
+
+	spdlog::info("Parsed {} reports {} times", reports.size(), runs);
+	spdlog::info("Heatmaps: {}, Stylus: {}, DFT: {}", sink.heatmaps, sink.stylus, sink.dft);
+	spdlog::info("Callbacks (std::function): {:.2f}ns per report", time_dynamic);
+	spdlog::info("Static sink (BasicParser): {:.2f}ns per report", time_fixed);
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::perf::parser
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::perf::parser::run(argc, argv);
+	} catch (std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -3,7 +3,9 @@
 #ifndef IPTSD_APPS_PERF_PERF_HPP
 #define IPTSD_APPS_PERF_PERF_HPP
 
+#include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/histogram.hpp>
 #include <common/types.hpp>
 #include <contacts/finder.hpp>
 #include <core/generic/application.hpp>
@@ -13,6 +15,7 @@
 #include <gsl/gsl>
 
 #include <algorithm>
+#include <array>
 #include <optional>
 #include <ratio>
 #include <utility>
@@ -25,15 +28,24 @@ private:
 	using clock = chrono::steady_clock;
 
 public:
-	usize total = 0;
-	usize total_of_squares = 0;
-	usize count = 0;
+	// The lowest amount of contacts in every bucket of @ref by_contacts.
+	static constexpr std::array<usize, 6> CONTACT_BUCKETS {0, 1, 2, 3, 5, 10};
+
+	// How long it took to process reports that contained a heatmap (in nanoseconds).
+	Histogram total {};
+
+	// The same durations, split by how many contacts were found in the heatmap.
+	std::array<Histogram, CONTACT_BUCKETS.size()> by_contacts {};
+
+	// For calculating the standard deviation of the durations (in microseconds).
+	f64 sum_of_squares = 0;
 
 	clock::duration min = clock::duration::max();
 	clock::duration max = clock::duration::min();
 
 private:
-	bool m_had_heatmap {};
+	// How many contacts were found in the heatmap of the current report, if it had one.
+	std::optional<usize> m_contacts = std::nullopt;
 
 public:
 	Perf(const core::Config &config,
@@ -41,9 +53,9 @@ public:
 	     std::optional<const ipts::Metadata> metadata)
 		: core::Application(config, info, metadata) {};
 
-	void on_contacts(const std::vector<contacts::Contact<f64>> & /* unused */) override
+	void on_contacts(const std::vector<contacts::Contact<f64>> &contacts) override
 	{
-		m_had_heatmap = true;
+		m_contacts = contacts.size();
 	}
 
 	void on_data(const gsl::span<u8> data) override
@@ -54,22 +66,24 @@ public:
 		// Send the report to the finder through the parser for processing
 		core::Application::on_data(data);
 
-		if (std::exchange(m_had_heatmap, false)) {
-			// Take end time
-			const clock::time_point end = clock::now();
-			const clock::duration x_ns = end - start;
+		const std::optional<usize> contacts = std::exchange(m_contacts, std::nullopt);
+		if (!contacts.has_value())
+			return;
 
-			// Divide early for x and x**2 because they are overflowing
-			const usize x_us = chrono::duration_cast<microseconds<usize>>(x_ns).count();
+		// Take end time
+		const clock::time_point end = clock::now();
+		const clock::duration x_ns = end - start;
 
-			total += x_us;
-			total_of_squares += x_us * x_us;
+		const i64 ns = chrono::duration_cast<nanoseconds<i64>>(x_ns).count();
+		const f64 us = chrono::duration_cast<microseconds<f64>>(x_ns).count();
 
-			min = std::min(min, x_ns);
-			max = std::max(max, x_ns);
+		total.record(casts::to_unsigned(ns));
+		gsl::at(by_contacts, Perf::bucket(*contacts)).record(casts::to_unsigned(ns));
 
-			++count;
-		}
+		sum_of_squares += us * us;
+
+		min = std::min(min, x_ns);
+		max = std::max(max, x_ns);
 	}
 
 	/*!
@@ -77,17 +91,31 @@ public:
 	 *
 	 * This has to be done after every iteration to prevent
 	 * skewing the results due to finger tracking being different.
+	 * The collected durations are kept, so that they cover all iterations.
 	 */
 	void reset()
 	{
 		m_finder.reset();
+	}
 
-		total = 0;
-		total_of_squares = 0;
-		count = 0;
+	/*!
+	 * The index of the contact count bucket that an amount of contacts falls into.
+	 *
+	 * @param[in] contacts The amount of contacts.
+	 * @return The index of the bucket.
+	 */
+	static usize bucket(const usize contacts)
+	{
+		usize index = 0;
+
+		while (index + 1 < CONTACT_BUCKETS.size()) {
+			if (contacts < gsl::at(CONTACT_BUCKETS, index + 1))
+				break;
+
+			index++;
+		}
 
-		min = clock::duration::max();
-		max = clock::duration::min();
+		return index;
 	}
 };
 
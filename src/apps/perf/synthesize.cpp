@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "synthetic.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <core/linux/capture-writer.hpp>
+#include <core/linux/config-loader.hpp>
+#include <ipts/data.hpp>
+#include <ipts/protocol.hpp>
+
+#include <CLI/CLI.hpp>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace iptsd::apps::perf::synthesize {
+namespace {
+
+/*!
+ * Writes the ground truth of a frame as lines of CSV.
+ *
+ * @param[in] file The file to write to.
+ * @param[in] truth The objects that were placed into the frame.
+ */
+void write_truth(std::ofstream &file, const std::vector<synthetic::Truth> &truth)
+{
+	for (const synthetic::Truth &t : truth) {
+		file << fmt::format("{},{:.6f},{},{},{:.6f},{:.6f},{:.6f},{:.6f},{:.6f},{:.4f}\n",
+				    t.frame, t.time, t.type, t.index, t.position.x(),
+				    t.position.y(), t.size.x(), t.size.y(), t.orientation,
+				    t.pressure);
+	}
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for generating synthetic touch data with known contacts."};
+	app.set_config("--scenario", "", "Read the options from this file (INI format).");
+
+	std::filesystem::path output {};
+	app.add_option("OUTPUT", output)
+		->description("The file in which the data will be saved.")
+		->type_name("FILE")
+		->required();
+
+	std::filesystem::path truth_path {};
+	CLI::Option *truth_opt =
+		app.add_option("--truth", truth_path)
+			->description("Write the position of every contact in every frame (CSV).")
+			->type_name("FILE");
+
+	synthetic::Scenario scenario {};
+
+	app.add_option("--rows", scenario.rows)
+		->description("The height of the heatmap.")
+		->default_val(scenario.rows);
+
+	app.add_option("--cols", scenario.cols)
+		->description("The width of the heatmap.")
+		->default_val(scenario.cols);
+
+	app.add_option("--width", scenario.width)
+		->description("The physical width of the screen (in cm).")
+		->default_val(scenario.width);
+
+	app.add_option("--height", scenario.height)
+		->description("The physical height of the screen (in cm).")
+		->default_val(scenario.height);
+
+	app.add_option("--fingers", scenario.fingers)
+		->description("How many fingers are touching the screen.")
+		->default_val(scenario.fingers);
+
+	app.add_option("--palms", scenario.palms)
+		->description("How many palms are touching the screen.")
+		->default_val(scenario.palms);
+
+	app.add_option("--speed", scenario.speed)
+		->description("How fast the fingers move (in heatmap pixels per second).")
+		->default_val(scenario.speed);
+
+	app.add_option("--noise", scenario.noise)
+		->description("The standard deviation of the sensor noise (from 0 to 255).")
+		->default_val(scenario.noise);
+
+	app.add_option("--strokes", scenario.strokes)
+		->description("How many strokes are drawn with a DFT pen.")
+		->default_val(scenario.strokes);
+
+	app.add_option("--duration", scenario.duration)
+		->description("How long the data covers (in seconds).")
+		->default_val(scenario.duration);
+
+	app.add_option("--rate", scenario.rate)
+		->description("How many heatmaps are sent per second.")
+		->default_val(scenario.rate);
+
+	app.add_option("--seed", scenario.seed)
+		->description("The seed for the random number generator.")
+		->default_val(scenario.seed);
+
+	u16 vendor {};
+	app.add_option("--vendor", vendor)
+		->description("The vendor ID of the device, for loading its configuration.")
+		->default_val(0x045E);
+
+	u16 product {};
+	app.add_option("--product", product)
+		->description("The product ID of the device, for loading its configuration.")
+		->default_val(0);
+
+	CLI11_PARSE(app, argc, argv);
+
+	// The generator only needs the config for the DFT parameters, so no device is required.
+	core::DeviceInfo info {};
+	info.vendor = vendor;
+	info.product = product;
+
+	const ipts::Metadata metadata = synthetic::Generator::metadata(scenario);
+
+	const core::linux::ConfigLoader loader {info, metadata};
+	synthetic::Generator generator {scenario, loader.config()};
+
+	info = generator.info(vendor, product);
+	core::linux::CaptureWriter writer {output, info, metadata};
+
+	std::optional<std::ofstream> truth = std::nullopt;
+
+	if (truth_opt->count() > 0) {
+		truth.emplace(truth_path);
+
+		if (!truth.value())
+			throw std::runtime_error {"Failed to open " + truth_path.string()};
+
+		*truth << "frame,time,type,index,x,y,major,minor,orientation,pressure\n";
+	}
+
+	// The pen sends its cycle of windows between two heatmaps.
+	constexpr std::array<u8, 3> windows {IPTS_DFT_ID_POSITION, IPTS_DFT_ID_BUTTON,
+					     IPTS_DFT_ID_PRESSURE};
+
+	const f64 period = 1e9 / scenario.rate;
+	std::vector<synthetic::Truth> objects {};
+
+	for (usize frame = 0; frame < generator.frames(); frame++) {
+		const f64 time = casts::to<f64>(frame) / scenario.rate;
+		const f64 ns = casts::to<f64>(frame) * period;
+
+		objects.clear();
+		writer.write(generator.heatmap(frame, objects), casts::to<u64>(std::round(ns)));
+
+		if (scenario.strokes > 0) {
+			const synthetic::Pen pen = generator.pen(time);
+
+			for (usize i = 0; i < windows.size(); i++) {
+				const f64 offset = casts::to<f64>(i + 1) * period / 4;
+				const auto timestamp = casts::to<u64>(std::round(ns + offset));
+
+				writer.write(generator.dft(gsl::at(windows, i), pen), timestamp);
+			}
+
+			if (pen.proximity)
+				objects.push_back(generator.stylus(frame, pen));
+		}
+
+		if (truth.has_value())
+			write_truth(*truth, objects);
+	}
+
+	writer.finish();
+
+	spdlog::info("Wrote {} frames of {}x{} heatmaps to {}", generator.frames(), scenario.cols,
+		     scenario.rows, output.string());
+
+	if (truth.has_value())
+		spdlog::info("Wrote ground truth to {}", truth_path.string());
+
+	return 0;
+}
+
+} // namespace
+} // namespace iptsd::apps::perf::synthesize
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::perf::synthesize::run(argc, argv);
+	} catch (std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,755 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_APPS_PERF_SYNTHETIC_HPP
+#define IPTSD_APPS_PERF_SYNTHETIC_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+#include <ipts/protocol.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::perf::synthetic {
+
+/*
+ * Describes the data that is generated.
+ */
+struct Scenario {
+	// The size of the heatmap.
+	usize rows = 44;
+	usize cols = 64;
+
+	// The physical size of the screen (in cm).
+	f64 width = 26.0;
+	f64 height = 17.3;
+
+	// How many fingers and palms are touching the screen.
+	usize fingers = 1;
+	usize palms = 0;
+
+	// How fast fingers move (in heatmap pixels per second). Palms move at a quarter of it.
+	f64 speed = 20;
+
+	// The standard deviation of the sensor noise (in raw heatmap units, from 0 to 255).
+	f64 noise = 1;
+
+	// How many strokes are drawn with a DFT pen. Zero disables the pen.
+	usize strokes = 0;
+
+	// How long the data covers (in seconds).
+	f64 duration = 10;
+
+	// How many heatmaps are sent per second.
+	f64 rate = 120;
+
+	// The seed of the random number generator. The same seed always produces the same data.
+	u32 seed = 0;
+};
+
+/*
+ * A gaussian shaped contact on the heatmap.
+ */
+struct Blob {
+	// The center of the contact (in heatmap pixels).
+	Vector2<f64> position = Vector2<f64>::Zero();
+
+	// How far the contact moves per second (in heatmap pixels).
+	Vector2<f64> velocity = Vector2<f64>::Zero();
+
+	// The standard deviation along the major and the minor axis (in heatmap pixels).
+	Vector2<f64> sigma = Vector2<f64>::Ones();
+
+	// The angle of the major axis to the x axis (in radians).
+	f64 angle = 0;
+
+	// The value at the center of the contact, from 0 to 1.
+	f64 amplitude = 0;
+
+	bool palm = false;
+};
+
+/*
+ * The state of the DFT pen.
+ */
+struct Pen {
+	bool proximity = false;
+
+	// The position of the pen (in antennas, the same as heatmap pixels).
+	Vector2<f64> position = Vector2<f64>::Zero();
+
+	// The pressure, from 0 to 1. The pen touches the screen if it is larger than zero.
+	f64 pressure = 0;
+};
+
+/*
+ * One object that was placed into a frame, in the coordinates that iptsd reports.
+ */
+struct Truth {
+	usize frame = 0;
+
+	// When the frame was sent (in seconds from the start).
+	f64 time = 0;
+
+	// "finger", "palm" or "stylus".
+	const char *type = "finger";
+
+	// The index of the contact. Stays the same across frames.
+	usize index = 0;
+
+	// The normalized position, from 0 to 1.
+	Vector2<f64> position = Vector2<f64>::Zero();
+
+	// The normalized diameter along the major and the minor axis (zero for the stylus).
+	Vector2<f64> size = Vector2<f64>::Zero();
+
+	// The normalized orientation, from 0 to 1, in the convention of the contact detector.
+	f64 orientation = 0;
+
+	// The pressure of the stylus (zero for touch contacts).
+	f64 pressure = 0;
+};
+
+/*
+ * Generates valid IPTS reports from a scenario, and remembers what they contain.
+ *
+ * The reports are laid out like the data of devices that natively support HID.
+ * Every heatmap is sent as a heatmap frame, with its dimensions and timestamp in a report
+ * frame in front of it. The pen is sent as DFT windows, which are built in a way that makes
+ * @ref core::DftStylus recover the exact position and pressure.
+ */
+class Generator {
+private:
+	// The raw value of a heatmap without any contacts (IPTS heatmaps are inverted).
+	static constexpr f64 BASELINE = 8.0 / 255.0;
+
+	// How many antennas are sent per row of a DFT window.
+	static constexpr u8 COMPONENTS = IPTS_DFT_NUM_COMPONENTS;
+
+	Scenario m_scenario;
+
+	// The exponent that the DFT stylus uses to linearize the antenna measurements.
+	f64 m_exponent;
+
+	std::mt19937 m_rng;
+	std::normal_distribution<f64> m_noise;
+
+	std::vector<Blob> m_blobs {};
+
+	// The contacts of the current frame, from 0 (no contact) to 1 (strong contact).
+	Image<f64> m_touch;
+
+	// The buffer that the current report is encoded into.
+	std::vector<u8> m_report {};
+
+	// The start and the end of every pen stroke.
+	std::vector<std::array<Vector2<f64>, 2>> m_strokes {};
+
+	// Counts the reports, like the firmware does.
+	u16 m_sequence = 0;
+
+public:
+	/*!
+	 * Creates a generator and places the contacts at random positions.
+	 *
+	 * @param[in] scenario The data that should be generated.
+	 * @param[in] config The configuration of the device, for the parameters of the DFT pen.
+	 */
+	Generator(const Scenario &scenario, const core::Config &config)
+		: m_scenario {scenario}
+		, m_exponent {config.dft_position_exp}
+		, m_rng {scenario.seed}
+		, m_noise {0, scenario.noise}
+		, m_touch {casts::to_eigen(scenario.rows), casts::to_eigen(scenario.cols)}
+	{
+		const usize min = std::min(scenario.rows, scenario.cols);
+		const usize max = std::max(scenario.rows, scenario.cols);
+
+		if (min < 4 || max > 255)
+			throw std::runtime_error {"The heatmap needs 4 to 255 rows and columns"};
+
+		if (scenario.rate <= 0 || scenario.duration <= 0)
+			throw std::runtime_error {"The rate and the duration must be positive"};
+
+		if (scenario.strokes > 0 && m_exponent >= 0)
+			throw std::runtime_error {"The DFT pen needs a negative position exponent"};
+
+		for (usize i = 0; i < scenario.fingers + scenario.palms; i++)
+			m_blobs.push_back(this->spawn(i >= scenario.fingers));
+
+		for (usize i = 0; i < scenario.strokes; i++)
+			m_strokes.push_back({this->point(1), this->point(1)});
+	}
+
+	/*!
+	 * How many heatmaps are generated for the scenario.
+	 */
+	[[nodiscard]] usize frames() const
+	{
+		return casts::to<usize>(std::ceil(m_scenario.duration * m_scenario.rate));
+	}
+
+	/*!
+	 * Describes the (non-existent) device that produced the data.
+	 *
+	 * @param[in] vendor The vendor ID of the device.
+	 * @param[in] product The product ID of the device.
+	 * @return Information about the device, including the largest report that it sends.
+	 */
+	[[nodiscard]] core::DeviceInfo info(const u16 vendor, const u16 product) const
+	{
+		core::DeviceInfo info {};
+		info.vendor = vendor;
+		info.product = product;
+		info.buffer_size = std::max(this->heatmap_size(), dft_size(IPTS_DFT_PRESSURE_ROWS));
+
+		return info;
+	}
+
+	/*!
+	 * The metadata of the device, which tells iptsd the size of the screen.
+	 *
+	 * It is needed for loading the config, before a generator can be created.
+	 *
+	 * @param[in] scenario The data that will be generated.
+	 * @return The metadata that describes the heatmap and the screen.
+	 */
+	[[nodiscard]] static ipts::Metadata metadata(const Scenario &scenario)
+	{
+		ipts::Metadata metadata {};
+
+		metadata.size.rows = casts::to<u32>(scenario.rows);
+		metadata.size.columns = casts::to<u32>(scenario.cols);
+
+		// The loader divides the size by 1000 to get centimeters.
+		metadata.size.width = casts::to<u32>(std::lround(scenario.width * 1e3));
+		metadata.size.height = casts::to<u32>(std::lround(scenario.height * 1e3));
+
+		// Only the sign of the transform is used, to determine if an axis is inverted.
+		metadata.transform.xx = 1;
+		metadata.transform.yy = 1;
+
+		return metadata;
+	}
+
+	/*!
+	 * Moves all contacts to their position in a frame and creates the heatmap report.
+	 *
+	 * Frames have to be generated in order, because the contacts move incrementally.
+	 *
+	 * @param[in] frame The number of the frame.
+	 * @param[out] truth The contacts that are visible in the frame are appended to this.
+	 * @return The report, which is valid until the next report is generated.
+	 */
+	gsl::span<const u8> heatmap(const usize frame, std::vector<Truth> &truth)
+	{
+		const f64 time = casts::to<f64>(frame) / m_scenario.rate;
+
+		const Eigen::Index rows = m_touch.rows();
+		const Eigen::Index cols = m_touch.cols();
+
+		const Vector2<f64> max {casts::to<f64>(cols - 1), casts::to<f64>(rows - 1)};
+		const f64 diagonal = max.norm();
+
+		m_touch.setConstant(BASELINE);
+
+		for (usize i = 0; i < m_blobs.size(); i++) {
+			Blob &blob = m_blobs[i];
+
+			if (frame > 0)
+				this->move(blob);
+
+			this->draw(blob);
+
+			Truth t {};
+			t.frame = frame;
+			t.time = time;
+			t.type = blob.palm ? "palm" : "finger";
+			t.index = i;
+			t.position = blob.position.cwiseQuotient(max);
+			t.size = blob.sigma * 2 / diagonal;
+
+			// The detector measures the angle of the minor axis to the y axis.
+			t.orientation = std::fmod(2 * M_PI - blob.angle, M_PI) / M_PI;
+
+			truth.push_back(t);
+		}
+
+		const u32 size = casts::to<u32>(rows * cols);
+
+		m_report.clear();
+		this->begin(casts::to<u32>(this->heatmap_size() - sizeof(struct ipts_header)));
+
+		usize reports = 2 * sizeof(struct ipts_report);
+		reports += sizeof(struct ipts_timestamp) + sizeof(struct ipts_dimensions);
+
+		this->frame(IPTS_HID_FRAME_TYPE_REPORTS, reports);
+		this->timestamp(frame);
+		this->dimensions();
+
+		this->frame(IPTS_HID_FRAME_TYPE_HEATMAP, sizeof(struct ipts_heatmap_header) + size);
+
+		struct ipts_heatmap_header header {};
+		header.size = size;
+		this->append(header);
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			for (Eigen::Index x = 0; x < cols; x++) {
+				const f64 touch = std::clamp(m_touch(y, x), 0.0, 1.0);
+				const f64 value = 255 * (1 - touch) + m_noise(m_rng);
+
+				const f64 clamped = std::clamp(std::round(value), 0.0, 255.0);
+
+				this->append(casts::to<u8>(clamped));
+			}
+		}
+
+		return m_report;
+	}
+
+	/*!
+	 * Where the pen is at a certain time.
+	 *
+	 * The strokes are spread evenly over the duration of the scenario. During every stroke,
+	 * the pen approaches the screen, draws a straight line while the pressure rises and
+	 * falls, and is lifted again.
+	 *
+	 * @param[in] time The time since the start (in seconds).
+	 * @return The state of the pen.
+	 */
+	[[nodiscard]] Pen pen(const f64 time) const
+	{
+		Pen pen {};
+
+		if (m_strokes.empty())
+			return pen;
+
+		const f64 period = m_scenario.duration / casts::to<f64>(m_strokes.size());
+		const auto index = casts::to<usize>(std::floor(time / period));
+		const usize stroke = std::min(index, m_strokes.size() - 1);
+
+		// How far the current stroke has progressed.
+		const f64 progress = time / period - casts::to<f64>(stroke);
+
+		if (progress > 0.8)
+			return pen;
+
+		const auto &[start, end] = m_strokes[stroke];
+
+		pen.proximity = true;
+		pen.position = start + (end - start) * (progress / 0.8);
+
+		if (progress > 0.1 && progress < 0.7)
+			pen.pressure = 0.8 * std::sin((progress - 0.1) / 0.6 * M_PI);
+
+		return pen;
+	}
+
+	/*!
+	 * Creates a report containing a DFT window.
+	 *
+	 * @param[in] type The type of the window (position, button or pressure).
+	 * @param[in] pen The state of the pen.
+	 * @return The report, which is valid until the next report is generated.
+	 */
+	gsl::span<const u8> dft(const u8 type, const Pen &pen)
+	{
+		std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> x {};
+		std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> y {};
+
+		u8 rows = 1;
+
+		// A window with weak rows is interpreted as a lifted pen.
+		if (pen.proximity && type == IPTS_DFT_ID_POSITION) {
+			rows = 2;
+
+			x[0] = this->position(pen.position.x(), m_scenario.cols);
+			y[0] = this->position(pen.position.y(), m_scenario.rows);
+		}
+
+		if (pen.proximity && type == IPTS_DFT_ID_PRESSURE) {
+			rows = IPTS_DFT_PRESSURE_ROWS;
+			this->pressure(pen.pressure, x, y);
+		}
+
+		m_report.clear();
+		this->begin(casts::to<u32>(dft_size(rows) - sizeof(struct ipts_header)));
+
+		const usize window = sizeof(struct ipts_pen_dft_window) +
+				     2 * rows * sizeof(struct ipts_pen_dft_window_row);
+
+		usize reports = 2 * sizeof(struct ipts_report);
+		reports += sizeof(struct ipts_dimensions);
+
+		this->frame(IPTS_HID_FRAME_TYPE_REPORTS, reports + window);
+		this->dimensions();
+
+		struct ipts_report report {};
+		report.type = IPTS_REPORT_TYPE_PEN_DFT_WINDOW;
+		report.size = casts::to<u16>(window);
+		this->append(report);
+
+		struct ipts_pen_dft_window header {};
+		header.num_rows = rows;
+		header.seq_num = casts::to<u8>(m_sequence & 0xFF);
+		header.data_type = type;
+		this->append(header);
+
+		for (usize i = 0; i < rows; i++)
+			this->append(gsl::at(x, i));
+
+		for (usize i = 0; i < rows; i++)
+			this->append(gsl::at(y, i));
+
+		return m_report;
+	}
+
+	/*!
+	 * Converts the state of the pen to the coordinates that iptsd reports.
+	 *
+	 * @param[in] frame The number of the frame.
+	 * @param[in] pen The state of the pen.
+	 * @return The ground truth of the pen.
+	 */
+	[[nodiscard]] Truth stylus(const usize frame, const Pen &pen) const
+	{
+		const Vector2<f64> max {casts::to<f64>(m_scenario.cols - 1),
+					casts::to<f64>(m_scenario.rows - 1)};
+
+		Truth t {};
+		t.frame = frame;
+		t.time = casts::to<f64>(frame) / m_scenario.rate;
+		t.type = "stylus";
+		t.position = pen.position.cwiseQuotient(max);
+		t.pressure = pen.pressure;
+
+		return t;
+	}
+
+private:
+	/*!
+	 * A random point on the heatmap.
+	 *
+	 * @param[in] margin The minimum distance to the edges (in heatmap pixels).
+	 * @return The coordinates of the point.
+	 */
+	Vector2<f64> point(const f64 margin)
+	{
+		const f64 cols = casts::to<f64>(m_scenario.cols - 1);
+		const f64 rows = casts::to<f64>(m_scenario.rows - 1);
+
+		std::uniform_real_distribution<f64> x {margin, cols - margin};
+		std::uniform_real_distribution<f64> y {margin, rows - margin};
+
+		return Vector2<f64> {x(m_rng), y(m_rng)};
+	}
+
+	/*!
+	 * Creates a contact at a random position, moving into a random direction.
+	 *
+	 * @param[in] palm Whether to create a palm instead of a finger.
+	 * @return The new contact.
+	 */
+	Blob spawn(const bool palm)
+	{
+		std::uniform_real_distribution<f64> unit {0, 1};
+
+		Blob blob {};
+		blob.palm = palm;
+		blob.position = this->point(1);
+		blob.angle = unit(m_rng) * M_PI;
+
+		const f64 direction = unit(m_rng) * 2 * M_PI;
+		const f64 speed = palm ? m_scenario.speed / 4 : m_scenario.speed;
+
+		blob.velocity = Vector2<f64> {std::cos(direction), std::sin(direction)} * speed;
+
+		if (palm) {
+			blob.sigma = Vector2<f64> {4.0, 3.0} * (0.8 + 0.4 * unit(m_rng));
+			blob.amplitude = 0.6 + 0.2 * unit(m_rng);
+		} else {
+			blob.sigma.x() = 1.0 + 0.4 * unit(m_rng);
+			blob.sigma.y() = 0.9 + 0.2 * unit(m_rng);
+			blob.amplitude = 0.3 + 0.3 * unit(m_rng);
+		}
+
+		// The first axis is the major axis.
+		if (blob.sigma.y() > blob.sigma.x())
+			std::swap(blob.sigma.x(), blob.sigma.y());
+
+		return blob;
+	}
+
+	/*!
+	 * Moves a contact by one frame, bouncing off the edges of the heatmap.
+	 *
+	 * @param[in,out] blob The contact to move.
+	 */
+	void move(Blob &blob) const
+	{
+		const Vector2<f64> max {casts::to<f64>(m_scenario.cols - 2),
+					casts::to<f64>(m_scenario.rows - 2)};
+
+		blob.position += blob.velocity / m_scenario.rate;
+
+		for (Eigen::Index i = 0; i < 2; i++) {
+			if (blob.position(i) < 1) {
+				blob.position(i) = 2 - blob.position(i);
+				blob.velocity(i) = -blob.velocity(i);
+			}
+
+			if (blob.position(i) > max(i)) {
+				blob.position(i) = 2 * max(i) - blob.position(i);
+				blob.velocity(i) = -blob.velocity(i);
+			}
+		}
+	}
+
+	/*!
+	 * Adds a contact to the heatmap.
+	 *
+	 * @param[in] blob The contact to draw.
+	 */
+	void draw(const Blob &blob)
+	{
+		const f64 cos = std::cos(blob.angle);
+		const f64 sin = std::sin(blob.angle);
+
+		// Beyond four standard deviations, the contribution is below the resolution.
+		const f64 reach = 4 * blob.sigma.maxCoeff();
+
+		const Vector2<f64> min = (blob.position.array() - reach).floor().max(0);
+		const Vector2<f64> max = (blob.position.array() + reach).floor();
+
+		const auto x0 = casts::to<Eigen::Index>(min.x());
+		const auto y0 = casts::to<Eigen::Index>(min.y());
+
+		const auto x1 = std::min(casts::to<Eigen::Index>(max.x()), m_touch.cols() - 1);
+		const auto y1 = std::min(casts::to<Eigen::Index>(max.y()), m_touch.rows() - 1);
+
+		for (Eigen::Index y = y0; y <= y1; y++) {
+			for (Eigen::Index x = x0; x <= x1; x++) {
+				const f64 dx = casts::to<f64>(x) - blob.position.x();
+				const f64 dy = casts::to<f64>(y) - blob.position.y();
+
+				// Rotate the offset into the coordinate system of the ellipse.
+				const f64 u = (dx * cos + dy * sin) / blob.sigma.x();
+				const f64 v = (dy * cos - dx * sin) / blob.sigma.y();
+
+				m_touch(y, x) += blob.amplitude * std::exp(-0.5 * (u * u + v * v));
+			}
+		}
+	}
+
+	/*!
+	 * Builds the antenna measurements of one axis for a pen at a certain position.
+	 *
+	 * The DFT stylus raises the amplitudes to @ref m_exponent and fits a parabola through
+	 * the three strongest ones. The amplitudes are chosen so that this parabola is exact.
+	 *
+	 * @param[in] position The position on the axis (in antennas).
+	 * @param[in] antennas How many antennas the axis has.
+	 * @return The row of the DFT window.
+	 */
+	[[nodiscard]] struct ipts_pen_dft_window_row position(const f64 position,
+							      const usize antennas) const
+	{
+		struct ipts_pen_dft_window_row row {};
+
+		const i64 center = std::lround(position);
+		const i64 first = center - COMPONENTS / 2;
+
+		row.frequency = 0;
+		row.magnitude = 100'000;
+		row.first = casts::to<i8>(first);
+		row.last = casts::to<i8>(first + COMPONENTS - 1);
+		row.mid = casts::to<i8>(center);
+
+		for (u8 i = 0; i < COMPONENTS; i++) {
+			const i64 antenna = first + i;
+
+			// Antennas that are outside of the screen don't measure anything.
+			if (antenna < 0 || antenna >= casts::to<i64>(antennas))
+				continue;
+
+			const f64 distance = casts::to<f64>(antenna) - position;
+			const f64 parabola = 1 + distance * distance;
+			const f64 amplitude = 2000 * std::pow(parabola, 1 / m_exponent);
+
+			// All of the signal is in phase, the stylus only looks at the projection.
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+			row.imag[i] = casts::to<i16>(std::lround(amplitude));
+		}
+
+		return row;
+	}
+
+	/*!
+	 * Builds the rows of a pressure window.
+	 *
+	 * The DFT stylus searches for the strongest frequency and interpolates between it and
+	 * its neighbours. The rows are chosen so that the interpolation returns the pressure.
+	 *
+	 * @param[in] pressure The pressure of the pen, from 0 to 1.
+	 * @param[out] x The rows of the x axis.
+	 * @param[out] y The rows of the y axis.
+	 */
+	static void pressure(const f64 pressure,
+			     std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> &x,
+			     std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> &y)
+	{
+		constexpr u8 last = IPTS_DFT_PRESSURE_ROWS - 1;
+
+		// The frequency of the pen goes down as the pressure goes up.
+		const f64 frequency = (1 - pressure) * last;
+
+		const i64 peak = std::clamp<i64>(std::lround(frequency), 1, last - 1);
+		const f64 offset = frequency - casts::to<f64>(peak);
+
+		// The estimator returns (r0 - r2) / (2 * r1 - r0 - r2) for the three rows.
+		const std::array<f64, 3> values {(1 + offset) / 2, 1, (1 - offset) / 2};
+
+		for (usize i = 0; i < 3; i++) {
+			const usize index = casts::to<usize>(peak) + i - 1;
+
+			const auto value = casts::to<i16>(std::lround(gsl::at(values, i) * 8000));
+			const u32 magnitude = i == 1 ? 20'000 : 10'000;
+
+			gsl::at(x, index).real[COMPONENTS / 2] = value;
+			gsl::at(y, index).real[COMPONENTS / 2] = value;
+
+			gsl::at(x, index).magnitude = magnitude;
+			gsl::at(y, index).magnitude = magnitude;
+		}
+	}
+
+	/*!
+	 * The size of a report containing a heatmap.
+	 */
+	[[nodiscard]] usize heatmap_size() const
+	{
+		usize size = sizeof(struct ipts_header) + 3 * sizeof(struct ipts_hid_frame);
+
+		size += 2 * sizeof(struct ipts_report);
+		size += sizeof(struct ipts_timestamp) + sizeof(struct ipts_dimensions);
+		size += sizeof(struct ipts_heatmap_header) + m_scenario.rows * m_scenario.cols;
+
+		return size;
+	}
+
+	/*!
+	 * The size of a report containing a DFT window.
+	 *
+	 * @param[in] rows How many rows the window has.
+	 */
+	[[nodiscard]] static usize dft_size(const usize rows)
+	{
+		usize size = sizeof(struct ipts_header) + 2 * sizeof(struct ipts_hid_frame);
+
+		size += 2 * sizeof(struct ipts_report) + sizeof(struct ipts_dimensions);
+		size += sizeof(struct ipts_pen_dft_window);
+		size += 2 * rows * sizeof(struct ipts_pen_dft_window_row);
+
+		return size;
+	}
+
+	/*!
+	 * Starts a new report with the HID header and the root frame.
+	 *
+	 * @param[in] size The size of the root frame, including its header.
+	 */
+	void begin(const u32 size)
+	{
+		struct ipts_header header {};
+		header.report = 0x0B;
+		header.timestamp = m_sequence++;
+		this->append(header);
+
+		struct ipts_hid_frame root {};
+		root.size = size;
+		root.type = IPTS_HID_FRAME_TYPE_HID;
+		this->append(root);
+	}
+
+	/*!
+	 * Appends the header of a HID frame.
+	 *
+	 * @param[in] type The type of the frame.
+	 * @param[in] size The size of the data in the frame.
+	 */
+	void frame(const u8 type, const usize size)
+	{
+		struct ipts_hid_frame frame {};
+		frame.size = casts::to<u32>(sizeof(frame) + size);
+		frame.type = type;
+		this->append(frame);
+	}
+
+	/*!
+	 * Appends a timestamp report.
+	 *
+	 * @param[in] frame The number of the frame.
+	 */
+	void timestamp(const usize frame)
+	{
+		struct ipts_report report {};
+		report.type = IPTS_REPORT_TYPE_TIMESTAMP;
+		report.size = sizeof(struct ipts_timestamp);
+		this->append(report);
+
+		struct ipts_timestamp timestamp {};
+		timestamp.count = casts::to<u16>(frame & 0xFFFF);
+		timestamp.timestamp = casts::to<u32>(frame & 0xFFFFFFFF);
+		this->append(timestamp);
+	}
+
+	/*!
+	 * Appends a dimensions report.
+	 */
+	void dimensions()
+	{
+		struct ipts_report report {};
+		report.type = IPTS_REPORT_TYPE_DIMENSIONS;
+		report.size = sizeof(struct ipts_dimensions);
+		this->append(report);
+
+		struct ipts_dimensions dim {};
+		dim.height = casts::to<u8>(m_scenario.rows);
+		dim.width = casts::to<u8>(m_scenario.cols);
+		dim.y_max = casts::to<u8>(m_scenario.rows - 1);
+		dim.x_max = casts::to<u8>(m_scenario.cols - 1);
+		dim.z_max = 255;
+		this->append(dim);
+	}
+
+	/*!
+	 * Appends a packed structure to the current report.
+	 *
+	 * @param[in] value The structure to append.
+	 */
+	template <class T>
+	void append(const T &value)
+	{
+		const gsl::span<const T> span {&value, 1};
+		const gsl::span<const std::byte> bytes = gsl::as_bytes(span);
+
+		std::transform(bytes.begin(), bytes.end(), std::back_inserter(m_report),
+			       [](const std::byte b) { return std::to_integer<u8>(b); });
+	}
+};
+
+} // namespace iptsd::apps::perf::synthetic
+
+#endif // IPTSD_APPS_PERF_SYNTHETIC_HPP
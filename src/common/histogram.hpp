@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_HISTOGRAM_HPP
+#define IPTSD_COMMON_HISTOGRAM_HPP
+
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace iptsd {
+
+/*
+ * A histogram of unsigned values, that can be updated and read from different threads.
+ *
+ * The buckets are log-linear: Every power of two is split into the same amount of linear
+ * buckets. This covers the full range of a u64 with a bounded relative error (~6%), while
+ * recording a value is only a few instructions and doesn't need any locks.
+ */
+class Histogram {
+private:
+	// How many bits of a value are used to select the bucket inside of a power of two.
+	static constexpr usize LINEAR_BITS = 4;
+
+	// How many linear buckets every power of two is split into.
+	static constexpr usize LINEAR = usize {1} << LINEAR_BITS;
+
+	// The amount of buckets that is needed to cover all 64 bit values.
+	static constexpr usize BUCKETS = (64 - LINEAR_BITS + 1) * LINEAR;
+
+private:
+	std::array<std::atomic<u64>, BUCKETS> m_buckets {};
+
+	// How many values were recorded.
+	std::atomic<u64> m_count = 0;
+
+	// The sum of all recorded values.
+	std::atomic<u64> m_sum = 0;
+
+	// The largest value that was recorded.
+	std::atomic<u64> m_max = 0;
+
+public:
+	/*!
+	 * Adds a value to the histogram.
+	 *
+	 * @param[in] value The value to add.
+	 */
+	void record(const u64 value)
+	{
+		std::atomic<u64> &bucket = gsl::at(m_buckets, Histogram::bucket(value));
+
+		bucket.fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(value, std::memory_order_relaxed);
+
+		// Another thread might be recording a larger value at the same time.
+		u64 max = m_max.load(std::memory_order_relaxed);
+		while (value > max) {
+			if (m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+				break;
+		}
+	}
+
+	/*!
+	 * How many values were recorded.
+	 */
+	[[nodiscard]] u64 count() const
+	{
+		return m_count.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * The average of the recorded values, or 0 if no values were recorded.
+	 */
+	[[nodiscard]] f64 mean() const
+	{
+		const u64 count = this->count();
+		if (count == 0)
+			return 0;
+
+		return static_cast<f64>(m_sum.load(std::memory_order_relaxed)) /
+		       static_cast<f64>(count);
+	}
+
+	/*!
+	 * The sum of all recorded values.
+	 */
+	[[nodiscard]] u64 sum() const
+	{
+		return m_sum.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * The largest value that was recorded.
+	 */
+	[[nodiscard]] u64 max() const
+	{
+		return m_max.load(std::memory_order_relaxed);
+	}
+
+	/*!
+	 * Estimates the value below which a given fraction of the recorded values falls.
+	 *
+	 * The estimate is the upper bound of the bucket the percentile falls into,
+	 * so it is never lower than the real value.
+	 *
+	 * @param[in] fraction The fraction of values, between 0 and 1 (e.g. 0.99 for p99).
+	 * @return The estimated percentile, or 0 if no values were recorded.
+	 */
+	[[nodiscard]] u64 percentile(const f64 fraction) const
+	{
+		const u64 count = this->count();
+		if (count == 0)
+			return 0;
+
+		const f64 rank = std::ceil(fraction * static_cast<f64>(count));
+		const u64 target = std::max(u64 {1}, static_cast<u64>(rank));
+
+		u64 seen = 0;
+
+		for (usize i = 0; i < BUCKETS; i++) {
+			seen += gsl::at(m_buckets, i).load(std::memory_order_relaxed);
+
+			if (seen >= target)
+				return std::min(Histogram::upper(i), this->max());
+		}
+
+		return this->max();
+	}
+
+	/*!
+	 * All buckets that contain values.
+	 *
+	 * @return Pairs of the upper bound of a bucket and how many values it contains,
+	 *         in ascending order.
+	 */
+	[[nodiscard]] std::vector<std::pair<u64, u64>> buckets() const
+	{
+		std::vector<std::pair<u64, u64>> buckets {};
+
+		for (usize i = 0; i < BUCKETS; i++) {
+			const u64 count = gsl::at(m_buckets, i).load(std::memory_order_relaxed);
+
+			if (count > 0)
+				buckets.emplace_back(Histogram::upper(i), count);
+		}
+
+		return buckets;
+	}
+
+	/*!
+	 * Removes all recorded values.
+	 *
+	 * Values that are recorded at the same time might be partially lost.
+	 */
+	void reset()
+	{
+		for (std::atomic<u64> &bucket : m_buckets)
+			bucket.store(0, std::memory_order_relaxed);
+
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	/*!
+	 * The index of the bucket that a value is counted in.
+	 *
+	 * Values below the amount of linear buckets are counted exactly. For larger values,
+	 * the highest set bit selects the power of two and the bits below it the linear bucket.
+	 *
+	 * @param[in] value The value to look up.
+	 * @return The index of the bucket.
+	 */
+	static usize bucket(const u64 value)
+	{
+		if (value < LINEAR)
+			return value;
+
+		// The index of the highest set bit. The value is not zero, so this is always valid.
+		const auto msb = gsl::narrow_cast<usize>(63 - __builtin_clzll(value));
+		const usize shift = msb - LINEAR_BITS;
+
+		// The top bit is always set and selects the power of two instead.
+		const usize linear = (value >> shift) & (LINEAR - 1);
+
+		return (shift + 1) * LINEAR + linear;
+	}
+
+	/*!
+	 * The largest value that is counted in a bucket.
+	 *
+	 * @param[in] index The index of the bucket.
+	 * @return The upper bound (inclusive) of the bucket.
+	 */
+	static u64 upper(const usize index)
+	{
+		if (index < LINEAR)
+			return index;
+
+		const usize shift = index / LINEAR - 1;
+		const u64 lower = u64 {LINEAR + index % LINEAR} << shift;
+
+		return lower + ((u64 {1} << shift) - 1);
+	}
+};
+
+} // namespace iptsd
+
+#endif // IPTSD_COMMON_HISTOGRAM_HPP
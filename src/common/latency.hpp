@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_LATENCY_HPP
+#define IPTSD_COMMON_LATENCY_HPP
+
+#include "chrono.hpp"
+#include "histogram.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+
+namespace iptsd::latency {
+
+/*
+ * The stages that a report passes through, from reading it to emitting the input events.
+ */
+enum class Stage : u8 {
+	Read,       // Reading the report from the device.
+	Queue,      // Waiting for the processing thread, if reports are read on a separate thread.
+	Parse,      // Validating the structure of the report.
+	Normalize,  // Converting the heatmap to the range [0, 1].
+	Neutral,    // Calculating the neutral value of the heatmap.
+	Preprocess, // Subtracting the neutral value, blurring and searching for local maxima.
+	Cluster,    // Spanning clusters around the maxima.
+	Merge,      // Merging overlapping clusters.
+	Fit,        // Fitting gaussians onto the clusters.
+	Track,      // Assigning indices to the contacts.
+	Stabilize,  // Stabilizing the contacts over multiple frames.
+	Validate,   // Validating size and aspect ratio of the contacts.
+	Dft,        // Calculating the state of the stylus from DFT windows.
+	Emit,       // Sending the touch or stylus input events to the kernel.
+	Total,      // Everything from the read returning to the input events being sent.
+	Count,
+};
+
+/*!
+ * A short name for a stage, to be used in reports.
+ *
+ * @param[in] stage The stage to describe.
+ * @return The name of the stage.
+ */
+inline const char *name(const Stage stage)
+{
+	switch (stage) {
+	case Stage::Read:
+		return "read";
+	case Stage::Queue:
+		return "queue";
+	case Stage::Parse:
+		return "parse";
+	case Stage::Normalize:
+		return "normalize";
+	case Stage::Neutral:
+		return "neutral";
+	case Stage::Preprocess:
+		return "preprocess";
+	case Stage::Cluster:
+		return "cluster";
+	case Stage::Merge:
+		return "merge";
+	case Stage::Fit:
+		return "fit";
+	case Stage::Track:
+		return "track";
+	case Stage::Stabilize:
+		return "stabilize";
+	case Stage::Validate:
+		return "validate";
+	case Stage::Dft:
+		return "dft";
+	case Stage::Emit:
+		return "emit";
+	case Stage::Total:
+		return "total";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Is notified about the stages that are measured on a thread, to collect more than durations.
+ */
+class Observer {
+public:
+	Observer() = default;
+	virtual ~Observer() = default;
+
+	Observer(const Observer &) = delete;
+	Observer &operator=(const Observer &) = delete;
+	Observer(Observer &&) = delete;
+	Observer &operator=(Observer &&) = delete;
+
+	/*!
+	 * A stopwatch was created, the first stage starts now.
+	 */
+	virtual void start() = 0;
+
+	/*!
+	 * A stage ended, the next one starts now.
+	 *
+	 * @param[in] stage The stage that ended.
+	 */
+	virtual void lap(Stage stage) = 0;
+};
+
+namespace impl {
+
+// The durations of every stage in nanoseconds, for the whole process.
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+inline std::array<Histogram, static_cast<usize>(Stage::Count)> histograms {};
+
+// The observer of the stages of the current thread.
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+inline thread_local Observer *observer = nullptr;
+
+// Whether the stages of the current thread are measured.
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+inline thread_local bool enabled = true;
+
+} // namespace impl
+
+/*!
+ * Sets the observer that is notified about the stages that are measured on the calling thread.
+ *
+ * The observer has to stay alive until it is removed again.
+ *
+ * @param[in] observer The new observer, or nullptr to remove the current one.
+ */
+inline void observe(Observer *observer)
+{
+	impl::observer = observer;
+}
+
+/*!
+ * Enables or disables measuring the stages on the calling thread.
+ *
+ * All threads record into the same histograms. Threads that run many pipelines in parallel
+ * can disable measuring, so that they don't compete for the histograms. This also disables
+ * tracing the stages and notifying the observer.
+ *
+ * @param[in] enabled Whether the stages of the calling thread should be measured.
+ */
+inline void enable(const bool enabled)
+{
+	impl::enabled = enabled;
+}
+
+/*!
+ * The durations (in nanoseconds) that were recorded for a stage.
+ *
+ * The histogram can be read while the stage is still being recorded by another thread.
+ *
+ * @param[in] stage The stage to look up.
+ * @return The histogram of the stage.
+ */
+inline Histogram &histogram(const Stage stage)
+{
+	return gsl::at(impl::histograms, static_cast<usize>(stage));
+}
+
+/*!
+ * Records how long a stage took.
+ *
+ * @param[in] stage The stage that was measured.
+ * @param[in] duration How long the stage took.
+ */
+inline void record(const Stage stage, const chrono::steady_clock::duration duration)
+{
+	if (!impl::enabled)
+		return;
+
+	const auto ns = chrono::duration_cast<chrono::nanoseconds>(duration).count();
+	histogram(stage).record(static_cast<u64>(std::max(ns, decltype(ns) {0})));
+}
+
+/*!
+ * Records how much time has passed since a certain point.
+ *
+ * @param[in] stage The stage that was measured.
+ * @param[in] start When the stage started.
+ */
+inline void record_since(const Stage stage, const chrono::steady_clock::time_point start)
+{
+	if (!impl::enabled)
+		return;
+
+	record(stage, chrono::steady_clock::now() - start);
+}
+
+/*
+ * Measures stages that run one after another.
+ *
+ * Every stage is measured from the end of the previous one, so that only one
+ * clock read per stage is needed. If tracing is enabled, the stages are traced too.
+ */
+class Stopwatch {
+private:
+	// When the last stage ended.
+	chrono::steady_clock::time_point m_last = chrono::steady_clock::now();
+
+public:
+	Stopwatch()
+	{
+		if (impl::observer != nullptr)
+			impl::observer->start();
+	}
+
+	/*!
+	 * Creates a stopwatch whose first stage started at an earlier point.
+	 *
+	 * @param[in] start When the first stage started.
+	 */
+	explicit Stopwatch(const chrono::steady_clock::time_point start) : m_last {start}
+	{
+		if (impl::observer != nullptr)
+			impl::observer->start();
+	}
+
+	/*!
+	 * When the last stage ended, or the first one started if none has ended yet.
+	 */
+	[[nodiscard]] chrono::steady_clock::time_point last() const
+	{
+		return m_last;
+	}
+
+	/*!
+	 * Records the time since the stopwatch was created or the last stage was recorded.
+	 *
+	 * @param[in] stage The stage that just ended.
+	 */
+	void lap(const Stage stage)
+	{
+		if (!impl::enabled)
+			return;
+
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+		record(stage, now - m_last);
+
+		if constexpr (trace::ENABLED)
+			trace::complete(name(stage), m_last, now);
+
+		if (impl::observer != nullptr)
+			impl::observer->lap(stage);
+
+		m_last = now;
+	}
+};
+
+} // namespace iptsd::latency
+
+#endif // IPTSD_COMMON_LATENCY_HPP
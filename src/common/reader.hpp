@@ -8,6 +8,9 @@
 #include <gsl/gsl>
 
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
 
 namespace iptsd {
 
@@ -105,6 +108,131 @@ public:
 	}
 };
 
+/*
+ * A reader that does not check whether enough data is available.
+ *
+ * It provides the same interface as @ref Reader, but without any bounds checks or
+ * exceptions. It must only be used on data whose structure was validated before.
+ */
+class UncheckedReader {
+private:
+	gsl::span<u8> m_data;
+
+	// The current position in the data.
+	usize m_index = 0;
+
+public:
+	UncheckedReader(const gsl::span<u8> data) : m_data {data} {};
+
+	/*!
+	 * Fills a buffer with the data at the current position.
+	 *
+	 * @param[in] dest The destination and size of the data.
+	 */
+	void read(const gsl::span<u8> dest)
+	{
+		std::memcpy(dest.data(), this->current(), dest.size());
+		m_index += dest.size();
+	}
+
+	/*!
+	 * Moves the current position forward.
+	 *
+	 * @param[in] size How many bytes to skip.
+	 */
+	void skip(const usize size)
+	{
+		m_index += size;
+	}
+
+	/*!
+	 * How many bytes are left in the data.
+	 *
+	 * @return The amount of bytes that have not been read.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_data.size() - m_index;
+	}
+
+	/*!
+	 * Takes a chunk of bytes from the current position and splits it off.
+	 *
+	 * @param[in] size How many bytes to take.
+	 * @return The raw chunk of data.
+	 */
+	gsl::span<u8> subspan(const usize size)
+	{
+		const gsl::span<u8> sub {this->current(), size};
+		m_index += size;
+
+		return sub;
+	}
+
+	/*!
+	 * Takes a chunk of bytes from the current position and splits it off.
+	 *
+	 * @param[in] size How many bytes to take.
+	 * @return A new reader instance for the chunk of data.
+	 */
+	UncheckedReader sub(const usize size)
+	{
+		return UncheckedReader {this->subspan(size)};
+	}
+
+	/*!
+	 * Reads an object from the current position.
+	 *
+	 * @tparam The type (and size) of the object to read.
+	 * @return The object that was read.
+	 */
+	template <class T>
+	T read()
+	{
+		T value {};
+
+		std::memcpy(&value, this->current(), sizeof(value));
+		m_index += sizeof(value);
+
+		return value;
+	}
+
+	/*!
+	 * Takes an array of objects from the current position, without copying them.
+	 *
+	 * This is only possible for objects without alignment requirements,
+	 * like the packed structures that describe the IPTS protocol.
+	 *
+	 * @tparam T The type of the objects to take.
+	 * @param[in] count How many objects to take.
+	 * @return A view of the objects, that points into the data of the reader.
+	 */
+	template <class T>
+	gsl::span<const T> view(const usize count)
+	{
+		static_assert(alignof(T) == 1, "The type must not have alignment requirements!");
+		static_assert(std::is_trivially_copyable_v<T>,
+			      "The type must be trivially copyable!");
+
+		// We have to break type safety here, since all we have is a bytestream.
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		const gsl::span<const T> view {reinterpret_cast<const T *>(this->current()), count};
+		m_index += count * sizeof(T);
+
+		return view;
+	}
+
+private:
+	/*!
+	 * A pointer to the data at the current position.
+	 */
+	[[nodiscard]] u8 *current() const
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+		return m_data.data() + m_index;
+	}
+};
+
 } // namespace iptsd
 
 #endif // IPTSD_COMMON_READER_HPP
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_SPSC_QUEUE_HPP
+#define IPTSD_COMMON_SPSC_QUEUE_HPP
+
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+#include <optional>
+
+namespace iptsd {
+
+/*
+ * A lock-free queue with a fixed capacity, for exactly one producer and one consumer thread.
+ *
+ * @tparam T The type of the items. Should be cheap to copy, like an index into a buffer pool.
+ * @tparam N The capacity of the queue. Must be a power of two.
+ */
+template <class T, usize N>
+class SpscQueue {
+private:
+	static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity must be a power of two!");
+
+	// Keep the positions on different cache lines, so that the threads don't contend for them.
+	static constexpr usize CACHE_LINE = 64;
+
+private:
+	std::array<T, N> m_items {};
+
+	// The position where the next item will be pushed. Only written by the producer.
+	alignas(CACHE_LINE) std::atomic<usize> m_head = 0;
+
+	// The position where the next item will be popped. Only written by the consumer.
+	alignas(CACHE_LINE) std::atomic<usize> m_tail = 0;
+
+public:
+	/*!
+	 * Adds an item to the queue. Must only be called by the producer.
+	 *
+	 * @param[in] item The item to add.
+	 * @return false if the queue is full and the item was not added.
+	 */
+	bool push(const T &item)
+	{
+		const usize head = m_head.load(std::memory_order_relaxed);
+
+		if (head - m_tail.load(std::memory_order_acquire) == N)
+			return false;
+
+		gsl::at(m_items, head & (N - 1)) = item;
+		m_head.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/*!
+	 * Removes the oldest item from the queue. Must only be called by the consumer.
+	 *
+	 * @return The item, or nothing if the queue is empty.
+	 */
+	std::optional<T> pop()
+	{
+		const usize tail = m_tail.load(std::memory_order_relaxed);
+
+		if (tail == m_head.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		const T item = gsl::at(m_items, tail & (N - 1));
+		m_tail.store(tail + 1, std::memory_order_release);
+
+		return item;
+	}
+
+	/*!
+	 * How many items are currently in the queue.
+	 *
+	 * If called concurrently, the value might already be outdated when it is returned.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		const usize tail = m_tail.load(std::memory_order_acquire);
+		const usize head = m_head.load(std::memory_order_acquire);
+
+		return head - tail;
+	}
+
+	/*!
+	 * The maximum amount of items that fit into the queue.
+	 */
+	[[nodiscard]] static constexpr usize capacity()
+	{
+		return N;
+	}
+};
+
+} // namespace iptsd
+
+#endif // IPTSD_COMMON_SPSC_QUEUE_HPP
@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_TRACE_HPP
+#define IPTSD_COMMON_TRACE_HPP
+
+#include "casts.hpp"
+#include "chrono.hpp"
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+namespace iptsd::trace {
+
+// Whether tracing was enabled at compile time (meson option "trace").
+#ifdef IPTSD_TRACE
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+/*
+ * The beginning or the end of a traced stage, or a complete stage.
+ */
+struct Event {
+	// The name of the stage. Must be a string literal, it is not copied.
+	const char *name = nullptr;
+
+	// When the event happened, in nanoseconds of the steady clock.
+	u64 time = 0;
+
+	// How long a complete stage took, in nanoseconds.
+	u64 duration = 0;
+
+	// 'B' for the beginning of a stage, 'E' for the end, 'X' for a complete stage.
+	char phase = 'B';
+};
+
+namespace impl {
+
+/*
+ * The most recent events of one thread.
+ *
+ * Only the owning thread writes to it. Once it is full, the oldest events are overwritten.
+ *
+ * Other threads can copy the events while the owner keeps recording. This works like a seqlock:
+ * The owner announces which event it is about to overwrite before writing it, and a reader
+ * checks the announcement after copying, to drop the events that could have been overwritten
+ * in the meantime. The fields of the events are relaxed atomics, so that reading a slot while
+ * it is written is not a data race, only a torn event that is dropped afterwards.
+ */
+class Ring {
+public:
+	// How many events are kept. At ~30 events per frame, this covers a few thousand frames.
+	static constexpr usize CAPACITY = usize {1} << 16;
+
+private:
+	/*
+	 * Storage for one event that can be read while the owner writes it.
+	 */
+	struct Slot {
+		std::atomic<const char *> name = nullptr;
+		std::atomic<u64> time = 0;
+		std::atomic<u64> duration = 0;
+		std::atomic<char> phase = 'B';
+	};
+
+private:
+	std::array<Slot, CAPACITY> m_events {};
+
+	// How many events were recorded in total.
+	std::atomic<usize> m_head = 0;
+
+	// How many events were recorded, including the one that is currently being written.
+	std::atomic<usize> m_claimed = 0;
+
+	// The number of the thread, in the order the threads started tracing.
+	usize m_thread;
+
+public:
+	explicit Ring(const usize thread) : m_thread {thread} {};
+
+	void push(const Event &event)
+	{
+		const usize head = m_head.load(std::memory_order_relaxed);
+
+		// Announce that the oldest event is overwritten, before any of its fields change.
+		m_claimed.store(head + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		Slot &slot = gsl::at(m_events, head & (CAPACITY - 1));
+
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.time.store(event.time, std::memory_order_relaxed);
+		slot.duration.store(event.duration, std::memory_order_relaxed);
+		slot.phase.store(event.phase, std::memory_order_relaxed);
+
+		m_head.store(head + 1, std::memory_order_release);
+	}
+
+	[[nodiscard]] usize thread() const
+	{
+		return m_thread;
+	}
+
+	/*!
+	 * Copies the events that are currently stored, from oldest to newest.
+	 *
+	 * If the thread keeps recording while the events are copied,
+	 * the ones that were overwritten in the meantime are dropped.
+	 *
+	 * @return The stored events.
+	 */
+	[[nodiscard]] std::vector<Event> events() const
+	{
+		const usize end = m_head.load(std::memory_order_acquire);
+		const usize begin = end > CAPACITY ? end - CAPACITY : 0;
+
+		std::vector<Event> events {};
+		events.reserve(end - begin);
+
+		for (usize i = begin; i < end; i++) {
+			const Slot &slot = gsl::at(m_events, i & (CAPACITY - 1));
+
+			events.push_back(Event {
+				slot.name.load(std::memory_order_relaxed),
+				slot.time.load(std::memory_order_relaxed),
+				slot.duration.load(std::memory_order_relaxed),
+				slot.phase.load(std::memory_order_relaxed),
+			});
+		}
+
+		// If any copied field was written by a newer event, this sees its announcement.
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		const usize claimed = m_claimed.load(std::memory_order_relaxed);
+		const usize valid = claimed > CAPACITY ? claimed - CAPACITY : 0;
+
+		if (valid > begin) {
+			const usize dropped = std::min(valid - begin, events.size());
+			events.erase(events.begin(), events.begin() + casts::to_signed(dropped));
+		}
+
+		return events;
+	}
+};
+
+/*
+ * Keeps the rings of all threads, so that they can be exported from any thread.
+ */
+class Registry {
+private:
+	std::mutex m_lock {};
+	std::vector<std::unique_ptr<Ring>> m_rings {};
+
+public:
+	Ring &create()
+	{
+		const std::lock_guard<std::mutex> lock {m_lock};
+
+		m_rings.push_back(std::make_unique<Ring>(m_rings.size()));
+		return *m_rings.back();
+	}
+
+	template <class F>
+	void for_each(F &&func)
+	{
+		const std::lock_guard<std::mutex> lock {m_lock};
+
+		for (const std::unique_ptr<Ring> &ring : m_rings)
+			func(*ring);
+	}
+};
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+inline Registry registry {};
+
+/*!
+ * The ring of the calling thread. It is created when a thread records its first event.
+ */
+inline Ring &local()
+{
+	thread_local Ring &ring = registry.create();
+	return ring;
+}
+
+/*!
+ * Converts a point in time to nanoseconds.
+ */
+inline u64 nanoseconds(const chrono::steady_clock::time_point time)
+{
+	const auto ns = chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch());
+	return static_cast<u64>(ns.count());
+}
+
+/*!
+ * Records an event on the calling thread.
+ *
+ * @param[in] name The name of the stage.
+ * @param[in] phase Whether the stage begins ('B') or ends ('E').
+ */
+inline void record(const char *name, const char phase)
+{
+	const u64 now = nanoseconds(chrono::steady_clock::now());
+	local().push(Event {name, now, 0, phase});
+}
+
+} // namespace impl
+
+/*!
+ * Records a stage that was already measured on the calling thread.
+ *
+ * Callers should check @ref ENABLED first, this records even if tracing is disabled.
+ *
+ * @param[in] name The name of the stage. Must be a string literal.
+ * @param[in] start When the stage started.
+ * @param[in] end When the stage ended.
+ */
+inline void complete(const char *name,
+		     const chrono::steady_clock::time_point start,
+		     const chrono::steady_clock::time_point end)
+{
+	const u64 begin = impl::nanoseconds(start);
+	impl::local().push(Event {name, begin, impl::nanoseconds(end) - begin, 'X'});
+}
+
+/*
+ * Records the beginning and the end of a stage for its lifetime.
+ *
+ * If tracing is disabled at compile time, this does nothing and is optimized away.
+ */
+class Scope {
+#ifdef IPTSD_TRACE
+private:
+	const char *m_name;
+
+public:
+	explicit Scope(const char *name) : m_name {name}
+	{
+		impl::record(m_name, 'B');
+	}
+
+	~Scope()
+	{
+		impl::record(m_name, 'E');
+	}
+#else
+public:
+	explicit constexpr Scope(const char * /* unused */) {};
+#endif
+
+	Scope(const Scope &) = delete;
+	Scope &operator=(const Scope &) = delete;
+	Scope(Scope &&) = delete;
+	Scope &operator=(Scope &&) = delete;
+};
+
+/*!
+ * Writes nanoseconds as (fractional) microseconds, which is the unit of Chrome traces.
+ *
+ * @param[in] out The stream to write to.
+ * @param[in] ns The amount of nanoseconds.
+ */
+inline void microseconds(std::ostream &out, const u64 ns)
+{
+	out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000
+	    << std::setfill(' ');
+}
+
+/*!
+ * Writes the recorded events of all threads in the Chrome trace event format.
+ *
+ * The output can be loaded into chrome://tracing or https://ui.perfetto.dev.
+ *
+ * @param[in] out The stream to write the JSON document to.
+ */
+inline void write(std::ostream &out)
+{
+	out << "{\"traceEvents\":[";
+
+	bool first = true;
+
+	impl::registry.for_each([&](const impl::Ring &ring) {
+		for (const Event &event : ring.events()) {
+			if (!first)
+				out << ',';
+
+			first = false;
+
+			out << "\n{\"name\":\"" << event.name << '"';
+			out << ",\"ph\":\"" << event.phase << '"';
+			out << ",\"ts\":";
+			trace::microseconds(out, event.time);
+
+			if (event.phase == 'X') {
+				out << ",\"dur\":";
+				trace::microseconds(out, event.duration);
+			}
+
+			out << ",\"pid\":1,\"tid\":" << ring.thread() << '}';
+		}
+	});
+
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+/*!
+ * Writes the recorded events of all threads to a file in the Chrome trace event format.
+ *
+ * @param[in] path The file to write the JSON document to.
+ */
+inline void write(const std::filesystem::path &path)
+{
+	std::ofstream file {path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path.string()};
+
+	trace::write(file);
+}
+
+} // namespace iptsd::trace
+
+#endif // IPTSD_COMMON_TRACE_HPP
@@ -11,5 +11,6 @@
 #include "algorithms/maximas.hpp"
 #include "algorithms/neutral.hpp"
 #include "algorithms/overlaps.hpp"
+#include "algorithms/preprocess.hpp"
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_HPP
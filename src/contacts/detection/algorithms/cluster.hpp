@@ -5,100 +5,104 @@
 
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
 #include <limits>
+#include <type_traits>
 #include <vector>
 
 namespace iptsd::contacts::detection::cluster {
 
 namespace impl {
 
-template <class Derived>
-class RecursionState {
-private:
-	using T = typename DenseBase<Derived>::Scalar;
-
-public:
-	// The heatmap that is being processed.
-	std::reference_wrapper<const DenseBase<Derived>> heatmap;
-
-	T activation_threshold;
-	T deactivation_threshold;
-
-	// The cluster that is being spanned.
-	std::reference_wrapper<Box> cluster;
-
-	// Whether a point has been visited before.
-	std::reference_wrapper<Image<bool>> visited;
-
-public:
-	RecursionState(const DenseBase<Derived> &heatmap,
-		       T activation_threshold,
-		       T deactivation_threshold,
-		       Box &cluster,
-		       Image<bool> &visited)
-		: heatmap {heatmap}
-		, activation_threshold {activation_threshold}
-		, deactivation_threshold {deactivation_threshold}
-		, cluster {cluster}
-		, visited {visited} {};
-};
-
 /*!
  * Spans a cluster of points on a heatmap.
  *
- * The recursive worker function for finding clusters.
- * Do not call this directly, call @ref iptsd::contacts::detection::clusters::span()
+ * The worker function for finding clusters, which expands the cluster iteratively using
+ * an explicit stack instead of recursion. Do not call this directly, call
+ * @ref iptsd::contacts::detection::cluster::span() or use a
+ * @ref iptsd::contacts::detection::cluster::Labeling.
  *
- * @param[in] state The state struct for passing constant data to each recursion step.
- * @param[in] position The pixel of the heatmap that will be checked in this step.
- * @param[in] previous The value of the pixel that was checked in the step before.
+ * @param[in] heatmap The heatmap to build a cluster from.
+ * @param[in] position The starting position of the cluster.
+ * @param[in] activation_threshold The activation threshold for searching.
+ * @param[in] deactivation_threshold The deactivation threshold for searching.
+ * @param[in] label The label that marks pixels as visited by this cluster.
+ * @param[in,out] labels The label of the last cluster that visited a pixel.
+ * @param[in] stack Temporary storage for the pixels that still have to be expanded.
+ * @return The bounding box of the spanned cluster.
  */
 template <class Derived>
-void span_recursive(const RecursionState<Derived> state,
-		    const Point &position,
-		    const typename DenseBase<Derived>::Scalar previous)
+Box flood(const DenseBase<Derived> &heatmap,
+	  const Point &position,
+	  const typename DenseBase<Derived>::Scalar activation_threshold,
+	  const typename DenseBase<Derived>::Scalar deactivation_threshold,
+	  const u32 label,
+	  Image<u32> &labels,
+	  std::vector<Point> &stack)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
-	const DenseBase<Derived> &heatmap = state.heatmap;
+	Box cluster {};
+	cluster.setEmpty();
 
 	const Eigen::Index cols = heatmap.cols();
 	const Eigen::Index rows = heatmap.rows();
 
-	const Eigen::Index x = position.x();
-	const Eigen::Index y = position.y();
+	if (heatmap(position.y(), position.x()) <= deactivation_threshold)
+		return cluster;
+
+	stack.clear();
+	stack.push_back(position);
 
-	const T value = heatmap(y, x);
+	labels(position.y(), position.x()) = label;
+	cluster.extend(position);
 
-	if (value <= state.deactivation_threshold)
-		return;
+	// Adds a neighbour of a pixel to the cluster, if it isn't part of it yet.
+	const auto visit = [&](const Eigen::Index x, const Eigen::Index y, const T previous) {
+		const T value = heatmap(y, x);
 
-	// Don't allow the value to increase outside of the activation area
-	if (previous <= state.activation_threshold && value > previous)
-		return;
+		if (value <= deactivation_threshold)
+			return;
 
-	bool &visited = state.visited(y, x);
-	Box &cluster = state.cluster;
+		// Don't allow the value to increase outside of the activation area
+		if (previous <= activation_threshold && value > previous)
+			return;
 
-	if (visited)
-		return;
+		u32 &visited = labels(y, x);
 
-	visited = true;
+		if (visited == label)
+			return;
+
+		visited = label;
+
+		cluster.extend(Point {x, y});
+		stack.emplace_back(x, y);
+	};
 
-	if (!cluster.contains(position))
-		cluster.extend(position);
+	while (!stack.empty()) {
+		const Point current = stack.back();
+		stack.pop_back();
 
-	if (x < cols - 1)
-		span_recursive(state, {x + 1, y + 0}, value);
+		const Eigen::Index x = current.x();
+		const Eigen::Index y = current.y();
 
-	if (x > 0)
-		span_recursive(state, {x - 1, y + 0}, value);
+		const T value = heatmap(y, x);
 
-	if (y < rows - 1)
-		span_recursive(state, {x + 0, y + 1}, value);
+		if (x < cols - 1)
+			visit(x + 1, y, value);
 
-	if (y > 0)
-		span_recursive(state, {x + 0, y - 1}, value);
+		if (x > 0)
+			visit(x - 1, y, value);
+
+		if (y < rows - 1)
+			visit(x, y + 1, value);
+
+		if (y > 0)
+			visit(x, y - 1, value);
+	}
+
+	return cluster;
 }
 
 } // namespace impl
@@ -106,14 +110,16 @@ void span_recursive(const RecursionState<Derived> state,
 /*!
  * Spans a cluster of points on a heatmap.
  *
- * The function will begin at the starting position and recursively expand in all directions.
+ * The function will begin at the starting position and expand in all directions.
  * Pixels that are above the deactiviation threshold will be added to the cluster.
  * If a pixel is encountered that is below the threshold, or a pixel that has been visited
- * before, that recursion branch will terminate.
+ * before, the expansion in that direction will terminate.
  *
  * Once the value of a pixel has fallen below the activation threshold, it is not allowed
  * to raise again, to prevent connecting two contacts into one cluster.
  *
+ * To span the clusters of many points, use a @ref Labeling, which doesn't need to allocate.
+ *
  * @param[in] heatmap The heatmap to build a cluster from.
  * @param[in] position The starting position of the cluster (e.g. the local maxima).
  * @param[in] activation_threshold The activation threshold for searching.
@@ -126,35 +132,124 @@ Box span(const DenseBase<Derived> &heatmap,
 	 const typename DenseBase<Derived>::Scalar activation_threshold,
 	 const typename DenseBase<Derived>::Scalar deactivation_threshold)
 {
-	using T = typename DenseBase<Derived>::Scalar;
-
-	Box cluster {};
-	cluster.setEmpty();
-
 	const Eigen::Index cols = heatmap.cols();
 	const Eigen::Index rows = heatmap.rows();
 
 	const Eigen::Index x = position.x();
 	const Eigen::Index y = position.y();
 
-	if (x < 0 || x >= cols)
-		return cluster;
+	if (x < 0 || x >= cols || y < 0 || y >= rows) {
+		Box cluster {};
+		cluster.setEmpty();
 
-	if (y < 0 || y >= rows)
 		return cluster;
+	}
 
-	Image<bool> visited {rows, cols};
-	visited.setConstant(false);
-
-	const impl::RecursionState<Derived> state {
-		heatmap, activation_threshold, deactivation_threshold, cluster, visited,
-	};
+	Image<u32> labels {rows, cols};
+	labels.setZero();
 
-	impl::span_recursive(state, position, std::numeric_limits<T>::max());
+	std::vector<Point> stack {};
 
-	return cluster;
+	return impl::flood(heatmap, position, activation_threshold, deactivation_threshold, 1,
+			   labels, stack);
 }
 
+/*
+ * Spans the clusters around many points of a heatmap, e.g. all local maxima.
+ *
+ * The result is the same as calling @ref span for every point, but the buffers are shared
+ * between all clusters and reused for the next heatmap. Instead of clearing them, every
+ * cluster marks the pixels it visits with its own label.
+ *
+ * Inside of the activation area, the expansion can move in every direction. Points whose
+ * activation areas are connected will therefore always span the same cluster. If a point
+ * has already been visited by the cluster of another point, and is inside of the
+ * activation area, that cluster is reused instead of spanning it again. A palm with many
+ * local maxima only needs to be spanned once.
+ */
+template <class T>
+class Labeling {
+private:
+	// The label of the last cluster that visited a pixel.
+	Image<u32> m_labels {};
+
+	// The label that was given to the last cluster.
+	u32 m_label = 0;
+
+	// The pixels that still have to be expanded.
+	std::vector<Point> m_stack {};
+
+	// The clusters that were spanned for the current heatmap, by their label.
+	std::vector<Box> m_spanned {};
+
+public:
+	/*!
+	 * Spans the clusters around a list of points.
+	 *
+	 * @param[in] heatmap The heatmap to build the clusters from.
+	 * @param[in] positions The starting positions of the clusters (e.g. the local maxima).
+	 * @param[in] activation_threshold The activation threshold for searching.
+	 * @param[in] deactivation_threshold The deactivation threshold for searching.
+	 * @param[out] clusters The bounding box of the cluster of every position.
+	 */
+	template <class Derived>
+	void span(const DenseBase<Derived> &heatmap,
+		  const std::vector<Point> &positions,
+		  const T activation_threshold,
+		  const T deactivation_threshold,
+		  std::vector<Box> &clusters)
+	{
+		static_assert(std::is_same_v<typename DenseBase<Derived>::Scalar, T>);
+
+		const Eigen::Index cols = heatmap.cols();
+		const Eigen::Index rows = heatmap.rows();
+
+		clusters.clear();
+		m_spanned.clear();
+
+		if (m_labels.rows() != rows || m_labels.cols() != cols) {
+			m_labels.conservativeResize(rows, cols);
+			m_labels.setZero();
+			m_label = 0;
+		}
+
+		// Make sure that the labels of this heatmap can't clash with old ones.
+		if (m_label > std::numeric_limits<u32>::max() - positions.size()) {
+			m_labels.setZero();
+			m_label = 0;
+		}
+
+		// All labels above this one belong to the current heatmap.
+		const u32 first = m_label;
+
+		for (const Point &position : positions) {
+			const Eigen::Index x = position.x();
+			const Eigen::Index y = position.y();
+
+			Box &cluster = clusters.emplace_back();
+			cluster.setEmpty();
+
+			if (x < 0 || x >= cols || y < 0 || y >= rows)
+				continue;
+
+			const u32 visited = m_labels(y, x);
+
+			// The point is part of the activation area of a cluster that was spanned.
+			if (visited > first && heatmap(y, x) > activation_threshold) {
+				cluster = gsl::at(m_spanned, visited - first - 1);
+				continue;
+			}
+
+			m_label++;
+
+			cluster = impl::flood(heatmap, position, activation_threshold,
+					      deactivation_threshold, m_label, m_labels, m_stack);
+
+			m_spanned.push_back(cluster);
+		}
+	}
+};
+
 } // namespace iptsd::contacts::detection::cluster
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_CLUSTER_HPP
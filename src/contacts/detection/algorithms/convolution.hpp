@@ -101,6 +101,46 @@ inline void run(const DenseBase<DerivedData> &in,
 	}
 }
 
+/*!
+ * Runs a 2D convolution of a collection and a separable kernel.
+ *
+ * A separable kernel (like a gaussian) is the outer product of a 1D kernel with itself.
+ * Instead of the full 2D kernel, only the 1D kernel is applied to the rows and then to the
+ * columns, so the cost only grows linearly with the size of the kernel.
+ *
+ * The borders of the input data will be extended to prevent overflowing indices.
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The 1D kernel that is applied horizontally and vertically.
+ * @param[out] temp Storage for the intermediate result, with the same size as the input.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ */
+template <class DerivedData, class DerivedKernel>
+inline void run_separable(const DenseBase<DerivedData> &in,
+			  const DenseBase<DerivedKernel> &kernel,
+			  DenseBase<DerivedData> &temp,
+			  DenseBase<DerivedData> &out)
+{
+	impl::run_separable(in, kernel, temp, out);
+}
+
+/*!
+ * Convolves a single row with a 1D kernel.
+ *
+ * The borders of the row will be extended to prevent overflowing indices.
+ *
+ * @param[in] in The input row.
+ * @param[in] kernel The 1D kernel, with an odd amount of elements.
+ * @param[out] out A reference to the row where the results of the convolution are stored.
+ */
+template <class DerivedIn, class DerivedKernel, class DerivedOut>
+inline void run_row(const DenseBase<DerivedIn> &in,
+		    const DenseBase<DerivedKernel> &kernel,
+		    DenseBase<DerivedOut> &out)
+{
+	impl::run_row(in, kernel, out);
+}
+
 } // namespace iptsd::contacts::detection::convolution
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_CONVOLUTION_HPP
@@ -8,6 +8,9 @@
 
 #include <gsl/gsl>
 
+#include <cmath>
+#include <stdexcept>
+
 namespace iptsd::contacts::detection::kernels {
 
 /*!
@@ -49,6 +52,36 @@ Matrix<T, Rows, Cols> gaussian(const T sigma)
 	return kernel;
 }
 
+/*!
+ * Generates a 1D gaussian kernel.
+ *
+ * Convolving the rows and then the columns with this kernel is the same as convolving
+ * with the 2D kernel of @ref gaussian that has the same size and strength.
+ *
+ * @param[in] size How many elements the kernel will have. Must be odd.
+ * @param[in] sigma The strength of the kernel.
+ * @return A gaussian kernel with the given size and strength.
+ */
+template <class T>
+Vector<T> gaussian_1d(const Eigen::Index size, const T sigma)
+{
+	if (size < 1 || size % 2 != 1)
+		throw std::runtime_error("The size of a gaussian kernel must be odd!");
+
+	Vector<T> kernel {size};
+
+	const T center = casts::to<T>(size - 1) / casts::to<T>(2);
+
+	for (Eigen::Index i = 0; i < size; i++) {
+		const T v = (casts::to<T>(i) - center) / sigma;
+		kernel(i) = std::exp(gsl::narrow_cast<T>(-0.5) * v * v);
+	}
+
+	kernel /= kernel.sum();
+
+	return kernel;
+}
+
 } // namespace iptsd::contacts::detection::kernels
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_KERNELS_HPP
@@ -8,85 +8,202 @@
 #include <vector>
 
 namespace iptsd::contacts::detection::maximas {
+namespace impl {
 
 /*!
- * Searches for all local maxima in the given data.
+ * Checks whether a single pixel is a local maximum, ignoring neighbours outside of the data.
  *
- * @param[in] heatmap The data to process.
+ * @param[in] data The data to process.
+ * @param[in] y The row of the pixel.
+ * @param[in] x The column of the pixel.
+ * @param[in] threshold The value that the pixel has to be above.
+ * @return Whether the pixel is a local maximum.
+ */
+template <class Derived>
+bool is_max(const DenseBase<Derived> &data,
+	    const Eigen::Index y,
+	    const Eigen::Index x,
+	    typename DenseBase<Derived>::Scalar threshold)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const T value = data(y, x);
+
+	if (value <= threshold)
+		return false;
+
+	const bool can_up = y > 0;
+	const bool can_down = y < data.rows() - 1;
+	const bool can_left = x > 0;
+	const bool can_right = x < data.cols() - 1;
+
+	bool max = true;
+
+	if (can_left)
+		max &= data(y, x - 1) < value;
+
+	if (can_right)
+		max &= data(y, x + 1) <= value;
+
+	if (can_up) {
+		max &= data(y - 1, x) < value;
+
+		if (can_left)
+			max &= data(y - 1, x - 1) < value;
+
+		if (can_right)
+			max &= data(y - 1, x + 1) <= value;
+	}
+
+	if (can_down) {
+		max &= data(y + 1, x) <= value;
+
+		if (can_left)
+			max &= data(y + 1, x - 1) < value;
+
+		if (can_right)
+			max &= data(y + 1, x + 1) <= value;
+	}
+
+	return max;
+}
+
+/*!
+ * Searches for local maxima in one row of the given data.
+ *
+ * The rows above and below are only used for comparison, so they must already hold
+ * their final values.
+ *
+ * Instead of testing the neighbours of every pixel one by one, the largest "less than"
+ * neighbour of the whole row is calculated from the rows next to it, shifted by one column.
+ * Eigen processes this with vector instructions. Only the few pixels that are above this
+ * limit have to be compared with their "less or equal" neighbours. The pixels at the border
+ * of the data, whose neighbours are partially missing, are tested one by one.
+ *
+ * @param[in] data The data to process.
+ * @param[in] y The index of the row that is searched.
  * @param[in] threshold Only return local maxima whose value is above this threshold.
- * @param[out] maximas A reference to the vector where the found points will be stored.
+ * @param[in] temp Temporary storage for the comparisons.
+ * @param[out] maximas A reference to the vector where the found points will be appended.
  */
 template <class Derived>
-void find(const DenseBase<Derived> &data,
-	  typename DenseBase<Derived>::Scalar threshold,
-	  std::vector<Point> &maximas)
+void find_row(const DenseBase<Derived> &data,
+	      const Eigen::Index y,
+	      typename DenseBase<Derived>::Scalar threshold,
+	      Array<typename DenseBase<Derived>::Scalar> &temp,
+	      std::vector<Point> &maximas)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
 	/*
 	 * We use the following kernel to compare entries:
 	 *
-	 *   [< ] [< ] [< ]
+	 *   [< ] [< ] [<=]
 	 *   [< ] [  ] [<=]
-	 *   [<=] [<=] [<=]
+	 *   [< ] [<=] [<=]
 	 *
 	 * Half of the entries use "less or equal", the other half "less than" as
 	 * operators to ensure that we don't either discard any local maximas or
 	 * report some multiple times.
+	 *
+	 * A pixel is a local maximum if it is larger than the largest "less than"
+	 * neighbour, and larger or equal to the largest "less or equal" neighbour.
 	 */
 
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
 
-	maximas.clear();
+	// The first and the last row, or very narrow data.
+	if (y == 0 || y == rows - 1 || cols < 3) {
+		for (Eigen::Index x = 0; x < cols; x++) {
+			if (impl::is_max(data, y, x, threshold))
+				maximas.emplace_back(x, y);
+		}
 
-	for (Eigen::Index y = 0; y < rows; y++) {
-		const bool can_up = y > 0;
-		const bool can_down = y < rows - 1;
+		return;
+	}
 
-		for (Eigen::Index x = 0; x < cols; x++) {
-			const T value = data(y, x);
+	// The pixels that have all of their neighbours.
+	const Eigen::Index n = cols - 2;
 
-			if (value <= threshold)
-				continue;
+	const auto up = data.row(y - 1);
+	const auto row = data.row(y);
+	const auto down = data.row(y + 1);
 
-			bool max = true;
+	temp.resize(n);
 
-			const bool can_left = x > 0;
-			const bool can_right = x < cols - 1;
+	// The largest "less than" neighbour of every pixel. The pixel has to be above the
+	// threshold too, so it is the smallest possible limit.
+	temp = row.segment(0, n)
+		       .max(up.segment(0, n))
+		       .max(up.segment(1, n))
+		       .max(down.segment(0, n))
+		       .max(threshold);
 
-			if (can_left)
-				max &= data(y, x - 1) < value;
+	if (impl::is_max(data, y, 0, threshold))
+		maximas.emplace_back(0, y);
 
-			if (can_right)
-				max &= data(y, x + 1) <= value;
+	// Most pixels fail the limit, only the remaining ones have to check the rest.
+	for (Eigen::Index x = 0; x < n; x++) {
+		const T value = row(x + 1);
 
-			if (can_up) {
-				max &= data(y - 1, x) < value;
+		if (value <= temp(x))
+			continue;
 
-				if (can_left)
-					max &= data(y - 1, x - 1) < value;
+		if (row(x + 2) <= value && up(x + 2) <= value && down(x + 1) <= value &&
+		    down(x + 2) <= value)
+			maximas.emplace_back(x + 1, y);
+	}
 
-				if (can_right)
-					max &= data(y - 1, x + 1) <= value;
-			}
+	if (impl::is_max(data, y, cols - 1, threshold))
+		maximas.emplace_back(cols - 1, y);
+}
 
-			if (can_down) {
-				max &= data(y + 1, x) <= value;
+} // namespace impl
 
-				if (can_left)
-					max &= data(y + 1, x - 1) < value;
+/*!
+ * Searches for all local maxima in the given data.
+ *
+ * Rows whose largest value is not above the threshold can't contain any local maxima
+ * and are skipped without looking at their neighbours.
+ *
+ * @param[in] heatmap The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[in] temp Temporary storage for the comparisons.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+void find(const DenseBase<Derived> &data,
+	  typename DenseBase<Derived>::Scalar threshold,
+	  Array<typename DenseBase<Derived>::Scalar> &temp,
+	  std::vector<Point> &maximas)
+{
+	maximas.clear();
 
-				if (can_right)
-					max &= data(y + 1, x + 1) <= value;
-			}
+	for (Eigen::Index y = 0; y < data.rows(); y++) {
+		if (data.row(y).maxCoeff() <= threshold)
+			continue;
 
-			if (max)
-				maximas.emplace_back(x, y);
-		}
+		impl::find_row(data, y, threshold, temp, maximas);
 	}
 }
 
+/*!
+ * Searches for all local maxima in the given data.
+ *
+ * @param[in] heatmap The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+void find(const DenseBase<Derived> &data,
+	  typename DenseBase<Derived>::Scalar threshold,
+	  std::vector<Point> &maximas)
+{
+	Array<typename DenseBase<Derived>::Scalar> temp {};
+	maximas::find(data, threshold, temp, maximas);
+}
+
 } // namespace iptsd::contacts::detection::maximas
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_MAXIMAS_HPP
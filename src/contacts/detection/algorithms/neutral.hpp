@@ -3,13 +3,182 @@
 #ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_NEUTRAL_HPP
 #define IPTSD_CONTACTS_DETECTION_ALGORITHMS_NEUTRAL_HPP
 
+#include <common/casts.hpp>
+#include <common/constants.hpp>
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <stdexcept>
 #include <type_traits>
-#include <unordered_map>
 
 namespace iptsd::contacts::detection::neutral {
 
+/*
+ * Calculates the statistical mode of heatmaps, using a histogram of 8 bit steps.
+ *
+ * This is exact for heatmaps that were normalized from the 8 bit data of the device, as long
+ * as that data lies within the range the device reported. Then all values are in the range
+ * [0, 1] and at least one step apart, and counting the steps takes the same time for every
+ * frame, regardless of its content. Heatmaps with values outside of [0, 1] are counted value
+ * by value instead, because clamping them to the outermost steps would merge distinct values.
+ */
+template <class T>
+class Mode {
+private:
+	// The input data is captured with 8 bits, so its values fall into this many steps.
+	static constexpr usize BINS = 256;
+
+	// Consecutive pixels are counted in different histograms,
+	// so that pixels with the same value don't have to wait for each other.
+	static constexpr usize LANES = 4;
+
+private:
+	std::array<std::array<u32, BINS>, LANES> m_counts {};
+
+	// The step of every pixel.
+	Image<u8> m_bins {};
+
+public:
+	/*!
+	 * Calculates the statistical mode of a heatmap.
+	 *
+	 * If multiple values are equally common, the one whose last occurrence comes first
+	 * is used. This is the value that would win when counting one pixel after another.
+	 *
+	 * @param[in] data The heatmap, with values that are at least 1/255 apart.
+	 * @return The most common value of the heatmap.
+	 */
+	template <class Derived>
+	T calculate(const DenseBase<Derived> &data)
+	{
+		const auto &array = data.derived().array();
+
+		// This also catches values that are not a number.
+		if (!((array >= Zero<T>()) && (array <= One<T>())).all())
+			return Mode::exact(data);
+
+		const auto max = casts::to<T>(BINS - 1);
+		const auto half = gsl::narrow_cast<T>(0.5);
+
+		// Round to the nearest step, the cast truncates. This is vectorized by Eigen.
+		const auto scaled = (array * max).max(Zero<T>()).min(max);
+		m_bins = (scaled + half).template cast<u8>();
+
+		for (std::array<u32, BINS> &counts : m_counts)
+			counts.fill(0);
+
+		const auto size = casts::to<usize>(m_bins.size());
+		const gsl::span<const u8> bins {m_bins.data(), size};
+
+		auto &[c0, c1, c2, c3] = m_counts;
+
+		usize i = 0;
+
+		for (; i + LANES <= size; i += LANES) {
+			gsl::at(c0, bins[i + 0])++;
+			gsl::at(c1, bins[i + 1])++;
+			gsl::at(c2, bins[i + 2])++;
+			gsl::at(c3, bins[i + 3])++;
+		}
+
+		for (; i < size; i++)
+			gsl::at(c0, bins[i])++;
+
+		u8 mode = 0;
+		u32 count = 0;
+		usize ties = 0;
+
+		for (usize bin = 0; bin < BINS; bin++) {
+			const u32 total = gsl::at(c0, bin) + gsl::at(c1, bin) + gsl::at(c2, bin) +
+					  gsl::at(c3, bin);
+
+			// Keep the total, the lanes are not needed anymore.
+			gsl::at(c0, bin) = total;
+
+			if (total > count) {
+				mode = gsl::narrow_cast<u8>(bin);
+				count = total;
+				ties = 1;
+			} else if (total == count) {
+				ties++;
+			}
+		}
+
+		if (count == 0)
+			return Zero<T>();
+
+		// Count the tied steps again, until the first one reaches the final count.
+		if (ties > 1) {
+			c1.fill(0);
+
+			for (const u8 bin : bins) {
+				if (gsl::at(c0, bin) != count)
+					continue;
+
+				if (++gsl::at(c1, bin) == count) {
+					mode = bin;
+					break;
+				}
+			}
+		}
+
+		static_assert(Image<u8>::IsRowMajor);
+
+		// Return the exact value of a pixel with that step.
+		const auto pixel = std::find(bins.begin(), bins.end(), mode);
+
+		const Eigen::Index index = std::distance(bins.begin(), pixel);
+		const Eigen::Index cols = m_bins.cols();
+
+		return data(index / cols, index % cols);
+	}
+
+private:
+	/*!
+	 * Calculates the statistical mode of a heatmap by counting every distinct value.
+	 *
+	 * Values that are not a number are ignored.
+	 *
+	 * @param[in] data The heatmap.
+	 * @return The most common value of the heatmap.
+	 */
+	template <class Derived>
+	static T exact(const DenseBase<Derived> &data)
+	{
+		const Eigen::Index cols = data.cols();
+		const Eigen::Index rows = data.rows();
+
+		std::map<T, u32> counts {};
+
+		u32 max_count = 0;
+		T max_element = Zero<T>();
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			for (Eigen::Index x = 0; x < cols; x++) {
+				const T value = data(y, x);
+
+				if (std::isnan(value))
+					continue;
+
+				const u32 count = ++counts[value];
+
+				if (count > max_count) {
+					max_count = count;
+					max_element = value;
+				}
+			}
+		}
+
+		return max_element;
+	}
+};
+
 namespace impl {
 
 /*!
@@ -23,27 +192,8 @@ typename DenseBase<Derived>::Scalar statistical_mode(const DenseBase<Derived> &d
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
-	const Eigen::Index cols = data.cols();
-	const Eigen::Index rows = data.rows();
-
-	std::map<T, u32> counts {};
-
-	u32 max_count = 0;
-	T max_element {};
-
-	for (Eigen::Index y = 0; y < rows; y++) {
-		for (Eigen::Index x = 0; x < cols; x++) {
-			const T value = data(y, x);
-			const u32 count = ++counts[value];
-
-			if (count > max_count) {
-				max_count = count;
-				max_element = value;
-			}
-		}
-	}
-
-	return max_element;
+	Mode<T> mode {};
+	return mode.calculate(data);
 }
 
 } // namespace impl
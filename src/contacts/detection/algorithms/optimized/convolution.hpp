@@ -5,5 +5,6 @@
 
 #include "convolution.3x3-extend.hpp"
 #include "convolution.5x5-extend.hpp"
+#include "convolution.separable-extend.hpp"
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_OPTIMIZED_CONVOLUTION_HPP
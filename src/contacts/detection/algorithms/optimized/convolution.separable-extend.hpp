@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/casts.hpp>
+#include <common/constants.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+
+namespace iptsd::contacts::detection::convolution::impl {
+
+/*!
+ * Convolves a single row with a 1D kernel.
+ *
+ * Pixels that are far enough from the left and right border are processed as one
+ * segment of the row, which Eigen vectorizes. Only the pixels close to the border have
+ * to clamp their indices.
+ *
+ * @param[in] in The input row.
+ * @param[in] kernel The 1D kernel, with an odd amount of elements.
+ * @param[out] out A reference to the row where the results of the convolution are stored.
+ */
+template <class DerivedIn, class DerivedKernel, class DerivedOut>
+inline void run_row(const DenseBase<DerivedIn> &in,
+		    const DenseBase<DerivedKernel> &kernel,
+		    DenseBase<DerivedOut> &out)
+{
+	using T = typename DenseBase<DerivedIn>::Scalar;
+
+	const Eigen::Index cols = in.size();
+
+	const Eigen::Index size = kernel.size();
+	const Eigen::Index radius = (size - 1) / 2;
+
+	// The pixels whose neighbours are all inside of the row.
+	const Eigen::Index inner = std::max(cols - 2 * radius, Eigen::Index {0});
+
+	// The pixels at the borders, where the row is extended.
+	const auto border = [&](const Eigen::Index x) {
+		auto v = Zero<T>();
+
+		for (Eigen::Index k = 0; k < size; k++) {
+			const Eigen::Index sx = x + k - radius;
+			v += in(std::clamp(sx, Eigen::Index {0}, cols - 1)) * kernel(k);
+		}
+
+		out(x) = v;
+	};
+
+	if (inner > 0) {
+		auto dest = out.segment(radius, inner);
+
+		dest = in.segment(0, inner) * kernel(0);
+
+		for (Eigen::Index k = 1; k < size; k++)
+			dest += in.segment(k, inner) * kernel(k);
+	}
+
+	for (Eigen::Index x = 0; x < std::min(radius, cols); x++)
+		border(x);
+
+	for (Eigen::Index x = std::max(radius, cols - radius); x < cols; x++)
+		border(x);
+}
+
+/*!
+ * Convolves every row of a matrix with a 1D kernel.
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The 1D kernel, with an odd amount of elements.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ */
+template <class DerivedData, class DerivedKernel>
+inline void run_horizontal(const DenseBase<DerivedData> &in,
+			   const DenseBase<DerivedKernel> &kernel,
+			   DenseBase<DerivedData> &out)
+{
+	for (Eigen::Index y = 0; y < in.rows(); y++) {
+		auto row = out.row(y);
+		impl::run_row(in.row(y), kernel, row);
+	}
+}
+
+/*!
+ * Convolves every column of a matrix with a 1D kernel.
+ *
+ * Every output row is the weighted sum of whole input rows, which are contiguous in
+ * memory and processed by Eigen with vector instructions. Rows outside of the matrix
+ * are replaced by the closest row.
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The 1D kernel, with an odd amount of elements.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ */
+template <class DerivedData, class DerivedKernel>
+inline void run_vertical(const DenseBase<DerivedData> &in,
+			 const DenseBase<DerivedKernel> &kernel,
+			 DenseBase<DerivedData> &out)
+{
+	const Eigen::Index rows = in.rows();
+
+	const Eigen::Index size = kernel.size();
+	const Eigen::Index radius = (size - 1) / 2;
+
+	const auto source = [&](const Eigen::Index y, const Eigen::Index k) {
+		return std::clamp(y + k - radius, Eigen::Index {0}, rows - 1);
+	};
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		auto dest = out.row(y);
+
+		dest = in.row(source(y, 0)) * kernel(0);
+
+		for (Eigen::Index k = 1; k < size; k++)
+			dest += in.row(source(y, k)) * kernel(k);
+	}
+}
+
+/*!
+ * Runs a 2D convolution of a matrix and a separable kernel.
+ *
+ * The kernel is applied to the rows first and then to the columns of the result.
+ * This takes 2n instead of n^2 operations per pixel for a kernel of size n.
+ * Do not call this directly, use @ref iptsd::contacts::detection::convolution::run_separable().
+ *
+ * @param[in] in The input data.
+ * @param[in] kernel The 1D kernel that is applied in both directions.
+ * @param[out] temp Storage for the result of the horizontal pass.
+ * @param[out] out A reference to the matrix where the results of the convolution are stored.
+ */
+template <class DerivedData, class DerivedKernel>
+inline void run_separable(const DenseBase<DerivedData> &in,
+			  const DenseBase<DerivedKernel> &kernel,
+			  DenseBase<DerivedData> &temp,
+			  DenseBase<DerivedData> &out)
+{
+	impl::run_horizontal(in, kernel, temp);
+	impl::run_vertical(temp, kernel, out);
+}
+
+} // namespace iptsd::contacts::detection::convolution::impl
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_PREPROCESS_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_PREPROCESS_HPP
+
+#include "convolution.hpp"
+#include "maximas.hpp"
+
+#include <common/constants.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace iptsd::contacts::detection::preprocess {
+
+/*
+ * Prepares a heatmap for the cluster search in a single sweep over its rows.
+ *
+ * Every row is only read once: The neutral value is subtracted, the row is blurred
+ * horizontally and then stored in a small window that holds as many rows as the kernel.
+ * From this window, the vertical blur produces the final row, and as soon as the rows
+ * around it are done, the previous row is searched for local maxima. This keeps the
+ * working set inside of the cache and doesn't need full size intermediate images.
+ *
+ * The results are the same as running the neutral subtraction, @ref convolution::run_separable
+ * and @ref maximas::find one after another.
+ */
+template <class T>
+class Sweep {
+private:
+	// The rows of the heatmap that were blurred horizontally, indexed by row modulo size.
+	Image<T> m_window {};
+
+	// A row of the heatmap with the neutral value subtracted.
+	Array<T> m_row {};
+
+	// Whether a row of the blurred heatmap contains pixels above the threshold.
+	// Rows without such pixels can't contain local maxima, so they are not searched.
+	std::vector<bool> m_active {};
+
+	// Temporary storage for the search of local maxima.
+	Array<T> m_maximas {};
+
+public:
+	/*!
+	 * Subtracts the neutral value, blurs the heatmap and searches it for local maxima.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[in] neutral The neutral value of the heatmap.
+	 * @param[in] kernel The 1D kernel that is applied horizontally and vertically.
+	 * @param[in] threshold Only return local maxima whose value is above this threshold.
+	 * @param[out] out The blurred heatmap. Must have the same size as the input.
+	 * @param[out] maximas A reference to the vector where the found points will be stored.
+	 */
+	template <class DerivedData, class DerivedKernel, class DerivedOut>
+	void run(const DenseBase<DerivedData> &heatmap,
+		 const T neutral,
+		 const DenseBase<DerivedKernel> &kernel,
+		 const T threshold,
+		 DenseBase<DerivedOut> &out,
+		 std::vector<Point> &maximas)
+	{
+		const Eigen::Index cols = heatmap.cols();
+		const Eigen::Index rows = heatmap.rows();
+
+		const Eigen::Index size = kernel.size();
+		const Eigen::Index radius = (size - 1) / 2;
+
+		if (m_window.rows() != size || m_window.cols() != cols) {
+			m_window.conservativeResize(size, cols);
+			m_row.conservativeResize(cols);
+		}
+
+		m_active.assign(casts::to_unsigned(rows), false);
+		maximas.clear();
+
+		// Rows outside of the heatmap are replaced by the closest row.
+		const auto source = [&](const Eigen::Index y) {
+			return std::clamp(y, Eigen::Index {0}, rows - 1);
+		};
+
+		// Prepares a row of the heatmap and stores it in the window.
+		const auto load = [&](const Eigen::Index y) {
+			auto slot = m_window.row(y % size);
+
+			m_row = (heatmap.row(y) - neutral).max(Zero<T>());
+			convolution::run_row(m_row, kernel, slot);
+		};
+
+		// Searches a finished row for local maxima.
+		const auto search = [&](const Eigen::Index y) {
+			if (m_active[casts::to_unsigned(y)])
+				maximas::impl::find_row(out, y, threshold, m_maximas, maximas);
+		};
+
+		for (Eigen::Index y = 0; y < std::min(radius, rows); y++)
+			load(y);
+
+		for (Eigen::Index y = 0; y < rows; y++) {
+			// The last row that is needed for the vertical blur.
+			if (y + radius < rows)
+				load(y + radius);
+
+			auto dest = out.row(y);
+
+			dest = m_window.row(source(y - radius) % size) * kernel(0);
+
+			for (Eigen::Index k = 1; k < size; k++)
+				dest += m_window.row(source(y + k - radius) % size) * kernel(k);
+
+			m_active[casts::to_unsigned(y)] = dest.maxCoeff() > threshold;
+
+			// The row above has all of its neighbours now.
+			if (y > 0)
+				search(y - 1);
+		}
+
+		if (rows > 0)
+			search(rows - 1);
+	}
+};
+
+} // namespace iptsd::contacts::detection::preprocess
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_PREPROCESS_HPP
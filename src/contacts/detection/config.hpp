@@ -9,6 +9,8 @@
 #include <common/constants.hpp>
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
 #include <optional>
 
 namespace iptsd::contacts::detection {
@@ -41,6 +43,17 @@ public:
 	 */
 	usize neutral_value_backoff = 1;
 
+	/*
+	 * The size of the gaussian kernel that is used to blur the heatmap. Must be odd.
+	 * Larger kernels remove more noise, but make contacts that are close together merge.
+	 */
+	usize blur_size = 3;
+
+	/*
+	 * The standard deviation of the gaussian kernel that is used to blur the heatmap.
+	 */
+	T blur_sigma = gsl::narrow_cast<T>(0.75);
+
 	/*
 	 * If a pixel of the input data is larger than this value plus the neutral value
 	 * it is marked as a contact and a recursive cluster search is started.
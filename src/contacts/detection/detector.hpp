@@ -9,10 +9,13 @@
 
 #include <common/casts.hpp>
 #include <common/constants.hpp>
+#include <common/latency.hpp>
+#include <common/trace.hpp>
 #include <common/types.hpp>
 
 #include <gsl/gsl>
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <type_traits>
@@ -32,18 +35,24 @@ private:
 	// The diagonal of the heatmap.
 	T m_input_diagonal = Zero<T>();
 
-	// The heatmap with the neutral value subtracted.
-	Image<T> m_img_neutral {};
-
-	// The blurred heatmap.
+	// The blurred heatmap, with the neutral value subtracted.
 	Image<T> m_img_blurred {};
 
-	// The kernel that is used for blurring.
-	Matrix3<T> m_kernel_blur = kernels::gaussian<T, 3, 3>(gsl::narrow_cast<T>(0.75));
+	// Subtracts the neutral value, blurs the heatmap and searches for local maximas.
+	preprocess::Sweep<T> m_sweep {};
+
+	// The kernel that is used for blurring, applied to the rows and then to the columns.
+	Vector<T> m_kernel_blur {};
 
 	// The list of local maximas.
 	std::vector<Point> m_maximas {};
 
+	// The cluster around every local maximum.
+	std::vector<Box> m_spans {};
+
+	// Spans the clusters around the local maximas.
+	cluster::Labeling<T> m_labeling {};
+
 	// The list of spanned clusters.
 	std::vector<Box> m_clusters {};
 
@@ -59,17 +68,23 @@ private:
 	// How many frames are left before the neutral value has to be recalculated.
 	usize m_counter = 0;
 
+	// Calculates the statistical mode of the heatmap.
+	neutral::Mode<T> m_mode {};
+
 	// The cached neutral value of the heatmap.
 	T m_neutral = Zero<T>();
 
 public:
-	Detector(Config<T> config) : m_config {std::move(config)} {};
+	Detector(Config<T> config)
+		: m_config {std::move(config)}
+		, m_kernel_blur {kernels::gaussian_1d<T>(casts::to_eigen(m_config.blur_size),
+							 m_config.blur_sigma)} {};
 
 	/*!
 	 * Search for contacts in a capacitive heatmap.
 	 *
-	 * This function uses a threshold based recursive descent to build
-	 * a list of connected clusters based on the (pre-processed) heatmap,
+	 * This function spans a cluster around every local maximum of the (pre-processed)
+	 * heatmap using an iterative, threshold based flood fill (see @ref cluster::Labeling),
 	 * and then uses gaussian fitting to fit an ellipse onto these clusters.
 	 *
 	 * @param[in] heatmap The heatmap to process.
@@ -85,12 +100,11 @@ public:
 
 		const Vector2<Eigen::Index> dimensions {cols - 1, rows - 1};
 
-		const Eigen::Index bcols = m_img_neutral.cols();
-		const Eigen::Index brows = m_img_neutral.rows();
+		const Eigen::Index bcols = m_img_blurred.cols();
+		const Eigen::Index brows = m_img_blurred.rows();
 
 		// Resize the internal buffers if neccessary.
 		if (brows != rows || bcols != cols) {
-			m_img_neutral.conservativeResize(rows, cols);
 			m_img_blurred.conservativeResize(rows, cols);
 			m_fitting_temp.conservativeResize(rows, cols);
 
@@ -102,31 +116,37 @@ public:
 		m_clusters.clear();
 		m_fitting_params.clear();
 
+		latency::Stopwatch watch {};
+
 		// Recalculate the neutral value if neccessary
 		if (m_counter == 0) {
-			m_neutral = neutral::calculate(heatmap, m_config.neutral_value_algorithm,
-						       m_config.neutral_value_offset);
+			const trace::Scope scope {"recalculate neutral"};
+
+			const neutral::Algorithm algorithm = m_config.neutral_value_algorithm;
+			const T offset = m_config.neutral_value_offset;
+
+			if (algorithm == neutral::Algorithm::MODE)
+				m_neutral = m_mode.calculate(heatmap) + offset;
+			else
+				m_neutral = neutral::calculate(heatmap, algorithm, offset);
 		}
 
 		// Update counter
 		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
 
-		// Subtract the neutral value from the whole heatmap
-		m_img_neutral = (heatmap - m_neutral).max(Zero<T>());
-
-		// Blur the heatmap slightly
-		convolution::run(m_img_neutral, m_kernel_blur, m_img_blurred);
+		watch.lap(latency::Stage::Neutral);
 
 		const T athresh = m_config.activation_threshold;
 		const T dthresh = m_config.deactivation_threshold;
 
-		// Search for local maximas
-		maximas::find(m_img_blurred, athresh, m_maximas);
+		// Subtract the neutral value, blur the heatmap and search for local maximas
+		m_sweep.run(heatmap, m_neutral, m_kernel_blur, athresh, m_img_blurred, m_maximas);
+		watch.lap(latency::Stage::Preprocess);
 
-		// Iterate over the maximas and start building clusters
-		for (const Point &point : m_maximas) {
-			Box cluster = cluster::span(m_img_blurred, point, athresh, dthresh);
+		// Build clusters around the maximas
+		m_labeling.span(m_img_blurred, m_maximas, athresh, dthresh, m_spans);
 
+		for (Box &cluster : m_spans) {
 			if (cluster.isEmpty())
 				continue;
 
@@ -144,8 +164,11 @@ public:
 			m_clusters.push_back(std::move(cluster));
 		}
 
+		watch.lap(latency::Stage::Cluster);
+
 		// Merge overlapping clusters
 		overlaps::merge(m_clusters, m_clusters_temp, 5);
+		watch.lap(latency::Stage::Merge);
 
 		// Prepare clusters for gaussian fitting
 		for (const Box &cluster : m_clusters) {
@@ -190,6 +213,8 @@ public:
 				Contact<T> {mean.template cast<T>(), size.template cast<T>(),
 					    gsl::narrow_cast<T>(orientation), m_config.normalize});
 		}
+
+		watch.lap(latency::Stage::Fit);
 	}
 };
 
@@ -10,6 +10,8 @@
 #include "tracking/tracker.hpp"
 #include "validation/validator.hpp"
 
+#include <common/latency.hpp>
+#include <common/trace.hpp>
 #include <common/types.hpp>
 
 #include <type_traits>
@@ -67,10 +69,21 @@ public:
 	template <int Rows, int Cols>
 	void find(const ImageBase<T, Rows, Cols> &heatmap, std::vector<Contact<T>> &contacts)
 	{
-		m_detector.detect(heatmap, contacts);
+		{
+			const trace::Scope scope {"detect"};
+			m_detector.detect(heatmap, contacts);
+		}
+
+		latency::Stopwatch watch {};
+
 		m_tracker.track(contacts);
+		watch.lap(latency::Stage::Track);
+
 		m_stabilizer.stabilize(contacts);
+		watch.lap(latency::Stage::Stabilize);
+
 		m_validator.validate(contacts);
+		watch.lap(latency::Stage::Validate);
 	}
 };
 
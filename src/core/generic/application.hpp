@@ -8,14 +8,16 @@
 #include "dft.hpp"
 
 #include <common/casts.hpp>
+#include <common/latency.hpp>
+#include <common/trace.hpp>
 #include <common/types.hpp>
 #include <contacts/finder.hpp>
 #include <ipts/data.hpp>
 #include <ipts/parser.hpp>
+#include <ipts/validator.hpp>
 
 #include <spdlog/spdlog.h>
 
-#include <functional>
 #include <stdexcept>
 #include <vector>
 
@@ -35,6 +37,33 @@ namespace iptsd::core {
  * need to be run by an application runner.
  */
 class Application {
+private:
+	/*
+	 * Receives the data from the parser and forwards it to the processing functions.
+	 *
+	 * The parser knows the type of this sink at compile time, so these calls can be inlined.
+	 */
+	struct ParserSink {
+		Application *app;
+
+		void on_stylus(const ipts::StylusData &data) const
+		{
+			app->process_stylus(data);
+		}
+
+		void on_heatmap(const ipts::Heatmap &data) const
+		{
+			app->process_heatmap(data);
+		}
+
+		void on_dft(const ipts::DftWindow &data) const
+		{
+			app->process_dft(data);
+		}
+
+		void on_metadata(const ipts::Metadata & /* unused */) const {};
+	};
+
 protected:
 	/*
 	 * The configuration for this application.
@@ -60,7 +89,7 @@ protected:
 	/*
 	 * Parses incoming data and returns heatmap, stylus and DFT data.
 	 */
-	ipts::Parser m_parser {};
+	ipts::BasicParser<ParserSink> m_parser;
 
 	/*
 	 * Temporary storage for normalized heatmap data.
@@ -80,6 +109,16 @@ protected:
 	 */
 	std::vector<contacts::Contact<f64>> m_contacts {};
 
+	/*
+	 * Whether the data that is currently processed is already outdated.
+	 */
+	bool m_stale = false;
+
+	/*
+	 * How many heatmaps were skipped, because newer data was already waiting.
+	 */
+	usize m_skipped_heatmaps = 0;
+
 	/*
 	 * Newer devices use a DFT based stylus interface. Instead of sending already processed
 	 * coordinates, these devices send antenna measurements that requires interpolating
@@ -94,6 +133,7 @@ public:
 		: m_config {config}
 		, m_info {info}
 		, m_metadata {metadata}
+		, m_parser {ParserSink {this}, config.stylus_all_samples}
 		, m_finder {config.contacts()}
 		, m_dft {config, metadata}
 	{
@@ -125,22 +165,54 @@ public:
 				metadata->unknown_byte, u[0], u[1], u[2], u[3], u[4], u[5], u[6],
 				u[7], u[8], u[9], u[10], u[11], u[12], u[13], u[14], u[15]);
 		}
-
-		m_parser.on_heatmap = [&](const auto &data) { this->process_heatmap(data); };
-		m_parser.on_stylus = [&](const auto &data) { this->process_stylus(data); };
-		m_parser.on_dft = [&](const auto &data) { this->process_dft(data); };
 	};
 
 	virtual ~Application() = default;
 
+	// The parser holds a pointer to the application, so it can't be copied.
+	Application(const Application &) = delete;
+	Application &operator=(const Application &) = delete;
+
 	/*!
 	 * Parse and process an IPTS data buffer.
 	 *
+	 * If newer data is already waiting, processing the heatmap would only delay it further.
+	 * Stylus data is always processed, since the stylus cycle spans multiple reports.
+	 *
 	 * @param[in] data The buffer to process.
+	 * @param[in] stale Whether to skip the heatmaps in this buffer.
 	 */
-	void process(const gsl::span<u8> data)
+	void process(const gsl::span<u8> data, const bool stale = false)
 	{
+		const trace::Scope scope {"process"};
+
+		m_stale = stale;
 		this->on_data(data);
+		m_stale = false;
+	}
+
+	/*!
+	 * The configuration that the application was created with.
+	 */
+	[[nodiscard]] const Config &config() const
+	{
+		return m_config;
+	}
+
+	/*!
+	 * How many heatmaps were skipped, because newer data was already waiting.
+	 */
+	[[nodiscard]] usize skipped_heatmaps() const
+	{
+		return m_skipped_heatmaps;
+	}
+
+	/*!
+	 * How often the parser rejected malformed data.
+	 */
+	[[nodiscard]] const ipts::ErrorCounters &parse_errors() const
+	{
+		return m_parser.errors();
 	}
 
 	/*!
@@ -153,6 +225,13 @@ public:
 	 */
 	virtual void on_stop() {};
 
+	/*!
+	 * For running application specific code when the device didn't send data for a while.
+	 *
+	 * This is only called by runners that support timeouts, and only if one was configured.
+	 */
+	virtual void on_timeout() {};
+
 protected:
 	/*!
 	 * For replacing the parsing step of the data with application
@@ -160,7 +239,14 @@ protected:
 	 */
 	virtual void on_data(const gsl::span<u8> data)
 	{
-		m_parser.parse(data);
+		const ipts::Status status = m_parser.try_parse(data);
+
+		if (status == ipts::Status::Ok)
+			return;
+
+		// Only log the first occurrence, the runner reports the totals when it stops.
+		if (m_parser.errors().get(status) == 1)
+			spdlog::warn("Ignoring malformed data ({})", ipts::describe(status));
 	}
 
 	/*!
@@ -184,6 +270,13 @@ private:
 	 */
 	void process_heatmap(const ipts::Heatmap &data)
 	{
+		if (m_stale) {
+			m_skipped_heatmaps++;
+			return;
+		}
+
+		const trace::Scope scope {"heatmap"};
+
 		const Eigen::Index rows = casts::to_eigen(data.dim.height);
 		const Eigen::Index cols = casts::to_eigen(data.dim.width);
 
@@ -194,17 +287,26 @@ private:
 		if (m_heatmap.rows() != rows || m_heatmap.cols() != cols)
 			m_heatmap.conservativeResize(data.dim.height, data.dim.width);
 
+		latency::Stopwatch watch {};
+
 		// Map the buffer to an Eigen container
 		const Eigen::Map<const Image<u8>> mapped {data.data.data(), rows, cols};
 
-		const auto z_min = casts::to<f64>(data.dim.z_min);
-		const auto z_max = casts::to<f64>(data.dim.z_max);
+		auto z_min = casts::to<f64>(data.dim.z_min);
+		auto z_max = casts::to<f64>(data.dim.z_max);
+
+		// An empty range can't be normalized, assume that the data uses all 8 bits instead.
+		if (z_min == z_max) {
+			z_min = 0;
+			z_max = 255;
+		}
 
 		// Normalize the heatmap to range [0, 1]
 		const auto norm = (mapped.cast<f64>() - z_min) / (z_max - z_min);
 
 		// IPTS sends inverted heatmaps
 		m_heatmap = 1.0 - norm;
+		watch.lap(latency::Stage::Normalize);
 
 		// Search for contacts
 		m_finder.find(m_heatmap, m_contacts);
@@ -232,6 +334,8 @@ private:
 	 */
 	void process_stylus(const ipts::StylusData &data)
 	{
+		const trace::Scope scope {"stylus"};
+
 		ipts::StylusData corrected = data;
 
 		// Correct position based on tip-transmitter distance
@@ -246,15 +350,24 @@ private:
 	/*!
 	 * Handles incoming DFT windows.
 	 *
-	 * DFT windows update the state of the DFT based stylus. The updated data is then
-	 * processed exactly like older data, through @ref process_stylus.
+	 * DFT windows update the state of the DFT based stylus. Once all windows of a cycle
+	 * were received, the updated data is processed exactly like older data,
+	 * through @ref process_stylus.
 	 *
 	 * @param[in] data The DFT window to process.
 	 */
 	void process_dft(const ipts::DftWindow &data)
 	{
-		m_dft.input(data);
-		this->process_stylus(m_dft.get_stylus());
+		const trace::Scope scope {"dft"};
+
+		latency::Stopwatch watch {};
+
+		const gsl::span<const ipts::StylusData> states = m_dft.input(data);
+		watch.lap(latency::Stage::Dft);
+
+		// A lift can complete two cycles at once, the older one has to be processed first.
+		for (const ipts::StylusData &stylus : states)
+			this->process_stylus(stylus);
 	}
 
 	/*!
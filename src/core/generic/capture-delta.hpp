@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_CAPTURE_DELTA_HPP
+#define IPTSD_CORE_GENERIC_CAPTURE_DELTA_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Compression of reports against the previous report of the same size.
+ *
+ * Consecutive heatmaps are nearly identical, so XORing a report with its predecessor yields
+ * mostly zeros. The result is stored as a sequence of runs:
+ *
+ *   { varint same, varint changed, u8 xor[changed] } ...
+ *
+ * where "same" is the number of bytes that are identical to the reference, and "changed" is
+ * the number of bytes that follow it, stored as the XOR of the report and the reference.
+ * The varints are LEB128 encoded. Bytes after the last run are identical to the reference.
+ */
+namespace iptsd::core::capture::delta {
+
+/*
+ * The amount of identical bytes that will end a run of changed bytes.
+ *
+ * Splitting a run costs at least two bytes for the varints,
+ * so shorter stretches of identical bytes are cheaper to store as changes.
+ */
+constexpr usize MIN_SAME_RUN = 3;
+
+namespace impl {
+
+inline void write_varint(std::vector<u8> &out, usize value)
+{
+	while (value >= 0x80) {
+		out.push_back(gsl::narrow_cast<u8>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+
+	out.push_back(gsl::narrow_cast<u8>(value));
+}
+
+inline usize read_varint(const gsl::span<const u8> in, usize &pos)
+{
+	usize value = 0;
+
+	for (usize shift = 0; shift < sizeof(usize) * 8; shift += 7) {
+		if (pos >= in.size())
+			throw std::runtime_error("Delta record ends in the middle of a varint!");
+
+		const u8 byte = in[pos++];
+		value |= casts::to<usize>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+
+	throw std::runtime_error("Delta record contains an invalid varint!");
+}
+
+/*!
+ * Counts how many bytes starting at pos are identical in both buffers.
+ */
+inline usize count_same(const gsl::span<const u8> a, const gsl::span<const u8> b, usize pos)
+{
+	const usize start = pos;
+
+	while (pos < a.size() && a[pos] == b[pos])
+		pos++;
+
+	return pos - start;
+}
+
+} // namespace impl
+
+/*!
+ * Encodes a report as the difference to a reference report of the same size.
+ *
+ * @param[in] data The report to encode.
+ * @param[in] reference The previous report with the same size.
+ * @param[out] out The encoded runs. Existing contents are replaced.
+ */
+inline void encode(const gsl::span<const u8> data,
+		   const gsl::span<const u8> reference,
+		   std::vector<u8> &out)
+{
+	if (data.size() != reference.size())
+		throw std::runtime_error("Delta reference does not match the size of the report!");
+
+	out.clear();
+
+	usize pos = 0;
+	while (pos < data.size()) {
+		const usize same = impl::count_same(data, reference, pos);
+		const usize start = pos + same;
+
+		if (start == data.size())
+			break;
+
+		// Extend the changed run until enough identical bytes follow to split it.
+		usize end = start;
+		while (end < data.size()) {
+			const usize next = impl::count_same(data, reference, end);
+
+			if (next >= MIN_SAME_RUN || end + next == data.size())
+				break;
+
+			end += std::max<usize>(next, 1);
+		}
+
+		impl::write_varint(out, same);
+		impl::write_varint(out, end - start);
+
+		for (usize i = start; i < end; i++)
+			out.push_back(gsl::narrow_cast<u8>(data[i] ^ reference[i]));
+
+		pos = end;
+	}
+}
+
+/*!
+ * Reconstructs a report from its difference to a reference report.
+ *
+ * The decoding happens in place, so that the reference is ready for the next report.
+ *
+ * @param[in] in The encoded runs.
+ * @param[in,out] report The reference report, which will be turned into the decoded report.
+ */
+inline void decode(const gsl::span<const u8> in, const gsl::span<u8> report)
+{
+	usize pos = 0;
+	usize offset = 0;
+
+	while (pos < in.size()) {
+		const usize same = impl::read_varint(in, pos);
+		const usize changed = impl::read_varint(in, pos);
+
+		if (same > report.size() - offset || changed > report.size() - offset - same)
+			throw std::runtime_error("Delta record is larger than the report!");
+
+		if (changed > in.size() - pos)
+			throw std::runtime_error("Delta record ends in the middle of a run!");
+
+		offset += same;
+
+		for (usize i = 0; i < changed; i++)
+			report[offset + i] ^= in[pos + i];
+
+		pos += changed;
+		offset += changed;
+	}
+}
+
+} // namespace iptsd::core::capture::delta
+
+#endif // IPTSD_CORE_GENERIC_CAPTURE_DELTA_HPP
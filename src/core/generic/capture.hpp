@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_CAPTURE_HPP
+#define IPTSD_CORE_GENERIC_CAPTURE_HPP
+
+#include "device.hpp"
+
+#include <common/types.hpp>
+
+#include <array>
+
+/*
+ * The binary format of the files written by iptsd-dump.
+ *
+ * Version 1 (legacy):
+ *
+ *   DeviceInfo, u8 has_meta, [ipts::Metadata]
+ *   { u64 size, u8 data[DeviceInfo::buffer_size] } ...
+ *
+ *   Every report is padded with zeros to the size of the buffer.
+ *
+ * Version 2:
+ *
+ *   Header, DeviceInfo, u8 has_meta, [ipts::Metadata]
+ *   { Record, u8 data[Record::size] } ...
+ *   Record (type = RECORD_TYPE_INDEX), IndexHeader, IndexEntry[frames], u64 buckets[buckets]
+ *   Footer
+ *
+ *   Every record only contains the bytes that were received, as well as the time at which
+ *   they were received. The index at the end of the file allows seeking to a certain frame
+ *   or a certain time without scanning the file. If the writer was interrupted, the index
+ *   and footer are missing, but all records can still be read sequentially.
+ *
+ *   If the header has FLAG_DELTA set, reports can also be stored as RECORD_TYPE_DELTA:
+ *
+ *   Record (type = RECORD_TYPE_DELTA), DeltaHeader, u8 runs[Record::size - sizeof(DeltaHeader)]
+ *
+ *   The runs describe the difference to the previous report with the same size (see
+ *   @ref core/generic/capture-delta.hpp). The first report of every size in a bucket of the
+ *   time index is always stored as a full report, so decoding can start at any bucket.
+ */
+
+namespace iptsd::core::capture {
+
+// clang-format off
+
+constexpr std::array<u8, 8> MAGIC = {'I', 'P', 'T', 'S', 'D', 'U', 'M', 'P'};
+
+constexpr u32 VERSION_1 = 1;
+constexpr u32 VERSION_2 = 2;
+
+constexpr u32 RECORD_TYPE_REPORT = 0;
+constexpr u32 RECORD_TYPE_INDEX  = 1;
+constexpr u32 RECORD_TYPE_DELTA  = 2;
+
+constexpr u32 FLAG_DELTA = 1 << 0;
+
+/*
+ * How much time is covered by one bucket of the time index (in nanoseconds).
+ */
+constexpr u64 INDEX_RESOLUTION = 100'000'000;
+
+// clang-format on
+
+/*
+ * The header at the start of a capture file (version 2 and newer).
+ *
+ * The first bytes of a version 1 file are a DeviceInfo struct. The bytes that overlap with
+ * the second half of the magic string are padding in DeviceInfo, and are always zero.
+ */
+struct [[gnu::packed]] Header {
+	std::array<u8, 8> magic;
+	u32 version;
+	u32 flags;
+};
+
+/*
+ * Precedes every chunk of data in a capture file.
+ */
+struct [[gnu::packed]] Record {
+	u32 type;
+	u32 size;
+
+	// The monotonic time at which the data was received, in nanoseconds.
+	u64 timestamp;
+};
+
+/*
+ * Precedes the runs of a report that is stored as the difference to its predecessor.
+ */
+struct [[gnu::packed]] DeltaHeader {
+	// The size of the decoded report.
+	u32 size;
+};
+
+/*
+ * Describes the contents of the index record at the end of the file.
+ */
+struct [[gnu::packed]] IndexHeader {
+	// How many report records are in the file.
+	u64 frames;
+
+	// How much time is covered by one bucket of the time index (in nanoseconds).
+	u64 resolution;
+
+	// How many buckets the time index has.
+	u64 buckets;
+};
+
+/*
+ * Locates one report record in the file.
+ */
+struct [[gnu::packed]] IndexEntry {
+	// The offset of the record header from the start of the file.
+	u64 offset;
+
+	// The timestamp of the record.
+	u64 timestamp;
+};
+
+/*
+ * The last bytes of a complete capture file.
+ */
+struct [[gnu::packed]] Footer {
+	// The offset of the index record from the start of the file.
+	u64 index;
+
+	std::array<u8, 8> magic;
+};
+
+static_assert(sizeof(Header) == 16);
+static_assert(sizeof(Record) == 16);
+static_assert(sizeof(DeltaHeader) == 4);
+static_assert(sizeof(IndexHeader) == 24);
+static_assert(sizeof(IndexEntry) == 16);
+static_assert(sizeof(Footer) == 16);
+
+} // namespace iptsd::core::capture
+
+#endif // IPTSD_CORE_GENERIC_CAPTURE_HPP
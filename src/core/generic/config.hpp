@@ -7,7 +7,9 @@
 #include <contacts/config.hpp>
 #include <ipts/parser.hpp>
 
+#include <algorithm>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 
@@ -15,6 +17,15 @@ namespace iptsd::core {
 
 class Config {
 public:
+	// [Daemon]
+	bool daemon_reader_thread = false;
+	std::string daemon_overload = "all";
+	std::string daemon_scheduler = "other";
+	i32 daemon_priority = 0;
+	std::string daemon_cpus;
+	bool daemon_lock_memory = false;
+	i32 daemon_timer_slack = -1;
+
 	// [Config]
 	bool invert_x = false;
 	bool invert_y = false;
@@ -31,6 +42,9 @@ public:
 	// [Contacts]
 	std::string contacts_neutral = "mode";
 	f64 contacts_neutral_value = 0;
+	usize contacts_neutral_backoff = 1;
+	usize contacts_blur_size = 3;
+	f64 contacts_blur_sigma = 0.75;
 	f64 contacts_activation_threshold = 24;
 	f64 contacts_deactivation_threshold = 20;
 	f64 contacts_size_thresh_min = 0.1;
@@ -46,6 +60,7 @@ public:
 
 	// [Stylus]
 	bool stylus_disable = false;
+	bool stylus_all_samples = false;
 	f64 stylus_tip_distance = 0;
 
 	// [DFT]
@@ -58,6 +73,22 @@ public:
 	f64 dft_tilt_distance = 0.6;
 
 public:
+	/*!
+	 * Whether heatmaps should be skipped if newer reports are already waiting.
+	 *
+	 * @return True for the "latest" overload policy, false for "all".
+	 */
+	[[nodiscard]] bool daemon_skip_stale() const
+	{
+		if (this->daemon_overload == "latest")
+			return true;
+
+		if (this->daemon_overload == "all")
+			return false;
+
+		throw std::runtime_error {"Invalid overload policy: " + this->daemon_overload};
+	}
+
 	/*!
 	 * Generates a configuration object for the contact detection library.
 	 *
@@ -85,8 +116,29 @@ public:
 
 		const f64 nval_offset = this->contacts_neutral_value;
 
+		// The neutral value has to be calculated at least once.
+		const usize backoff = std::max(this->contacts_neutral_backoff, usize {1});
+
 		config.detection.neutral_value_offset = nval_offset / 255.0;
-		config.detection.neutral_value_backoff = 16; // TODO: config option
+		config.detection.neutral_value_backoff = backoff;
+
+		const usize blur_size = this->contacts_blur_size;
+		const f64 blur_sigma = this->contacts_blur_sigma;
+
+		// The kernel needs a center pixel.
+		if (blur_size % 2 != 1) {
+			const std::string value = std::to_string(blur_size);
+			throw std::runtime_error {"Invalid [Contacts] BlurSize: " + value};
+		}
+
+		// Also rejects NaN, which would turn the whole heatmap into NaN.
+		if (!(blur_sigma > 0)) {
+			const std::string value = std::to_string(blur_sigma);
+			throw std::runtime_error {"Invalid [Contacts] BlurSigma: " + value};
+		}
+
+		config.detection.blur_size = blur_size;
+		config.detection.blur_sigma = blur_sigma;
 
 		const f64 diagonal = std::hypot(this->width, this->height);
 
@@ -8,7 +8,10 @@
 #include <common/casts.hpp>
 #include <ipts/data.hpp>
 
+#include <gsl/gsl>
+
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <optional>
 #include <utility>
@@ -20,9 +23,22 @@ private:
 	Config m_config;
 	std::optional<const ipts::Metadata> m_metadata;
 
-	// The current state of the DFT stylus.
+	// The state of the DFT stylus that is being assembled from the current cycle.
 	ipts::StylusData m_stylus;
 
+	// The state of the DFT stylus after the last completed cycle.
+	ipts::StylusData m_published;
+
+	// The states that were published by the last window. Lifting the stylus can
+	// complete the previous cycle and the current one at once, so there can be two.
+	std::array<ipts::StylusData, 2> m_batch {};
+
+	// How many states were published by the last window.
+	usize m_count = 0;
+
+	// Whether windows of a cycle were received that have not been published yet.
+	bool m_pending = false;
+
 	i32 m_real = 0;
 	i32 m_imag = 0;
 
@@ -34,34 +50,66 @@ public:
 	/*!
 	 * Loads a DFT window and calculates stylus properties from it.
 	 *
+	 * The stylus sends its state in cycles of multiple windows: The position comes first,
+	 * followed by the buttons and the pressure. The state is only published once a cycle
+	 * is complete, so that consumers never see a mix of old and new values.
+	 *
+	 * A cycle is complete when the pressure window was received, or when the stylus was
+	 * lifted. If a new position window arrives before that, the incomplete cycle is
+	 * published before the new one is started. If that window lifts the stylus, both
+	 * the incomplete cycle and the lift are published. The remaining windows of a lifted
+	 * stylus are not published, because they don't change its visible state.
+	 *
 	 * @param[in] dft The dft window received from the IPTS hardware.
+	 * @return The states that were published, oldest first. Valid until the next call.
 	 */
-	void input(const ipts::DftWindow &dft)
+	gsl::span<const ipts::StylusData> input(const ipts::DftWindow &dft)
 	{
+		m_count = 0;
+
 		switch (dft.type) {
 		case IPTS_DFT_ID_POSITION:
+			if (m_pending)
+				this->publish();
+
 			this->handle_position(dft);
+
+			// Once the stylus is lifted, there is nothing more to wait for.
+			if (!m_stylus.proximity) {
+				this->publish();
+				return this->published();
+			}
+
 			break;
 		case IPTS_DFT_ID_BUTTON:
 			this->handle_button(dft);
 			break;
 		case IPTS_DFT_ID_PRESSURE:
 			this->handle_pressure(dft);
-			break;
+
+			// The cycle of a lifted stylus was already published.
+			if (!m_stylus.proximity)
+				return this->published();
+
+			this->publish();
+			return this->published();
 		default:
 			// Ignored
-			break;
+			return this->published();
 		}
+
+		m_pending = m_stylus.proximity;
+		return this->published();
 	}
 
 	/*!
-	 * The current state of the DFT stylus.
+	 * The state of the DFT stylus after the last completed cycle.
 	 *
 	 * @return An object describing the current position and state of the DFT based stylus.
 	 */
 	[[nodiscard]] const ipts::StylusData &get_stylus() const
 	{
-		return m_stylus;
+		return m_published;
 	}
 
 private:
@@ -263,7 +311,7 @@ private:
 		u64 maxm = 0;
 
 		for (u8 i = 0; i < rows; i++) {
-			const u64 m = dft.x.at(i).magnitude + dft.y.at(i).magnitude;
+			const u64 m = dft.x[i].magnitude + dft.y[i].magnitude;
 
 			if (m > maxm) {
 				maxm = m;
@@ -297,8 +345,8 @@ private:
 			imag.at(i) = 0;
 
 			for (u8 j = 0; j < IPTS_DFT_NUM_COMPONENTS; j++) {
-				const struct ipts_pen_dft_window_row &x = dft.x.at(maxi + i - 1);
-				const struct ipts_pen_dft_window_row &y = dft.y.at(maxi + i - 1);
+				const struct ipts_pen_dft_window_row &x = dft.x[maxi + i - 1];
+				const struct ipts_pen_dft_window_row &y = dft.y[maxi + i - 1];
 
 				real.at(i) += gsl::at(x.real, j) + gsl::at(y.real, j);
 				imag.at(i) += gsl::at(x.imag, j) + gsl::at(y.imag, j);
@@ -316,6 +364,25 @@ private:
 		return (maxi + std::clamp(d, mind, maxd)) / (rows - 1);
 	}
 
+	/*!
+	 * Publishes the state of the current cycle.
+	 */
+	void publish()
+	{
+		m_published = m_stylus;
+		m_pending = false;
+
+		gsl::at(m_batch, m_count++) = m_stylus;
+	}
+
+	/*!
+	 * The states that were published by the current window.
+	 */
+	[[nodiscard]] gsl::span<const ipts::StylusData> published() const
+	{
+		return gsl::span<const ipts::StylusData> {m_batch}.first(m_count);
+	}
+
 	/*!
 	 * Marks the DFT stylus as lifted.
 	 */
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_ERROR_REPORT_HPP
+#define IPTSD_CORE_GENERIC_ERROR_REPORT_HPP
+
+#include <common/types.hpp>
+#include <ipts/validator.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace iptsd::core {
+
+/*!
+ * Logs how many reports were ignored because they were malformed, for every type of error.
+ *
+ * @param[in] errors The errors that were encountered while parsing.
+ */
+inline void log_parse_errors(const ipts::ErrorCounters &errors)
+{
+	for (usize i = 1; i < static_cast<usize>(ipts::Status::Count); i++) {
+		const auto status = static_cast<ipts::Status>(i);
+		const usize count = errors.get(status);
+
+		if (count == 0)
+			continue;
+
+		const char *reason = ipts::describe(status);
+		spdlog::warn("Ignored {} malformed reports ({})", count, reason);
+	}
+}
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_ERROR_REPORT_HPP
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_LATENCY_REPORT_HPP
+#define IPTSD_CORE_GENERIC_LATENCY_REPORT_HPP
+
+#include <common/histogram.hpp>
+#include <common/latency.hpp>
+#include <common/types.hpp>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace iptsd::core {
+
+/*!
+ * Formats the latencies that were recorded for every stage as a table.
+ *
+ * All durations are given in microseconds.
+ *
+ * @return The lines of the table.
+ */
+inline std::vector<std::string> latency_report()
+{
+	const auto us = [](const u64 ns) { return static_cast<f64>(ns) / 1e3; };
+
+	std::vector<std::string> lines {};
+	lines.push_back(fmt::format("{:<10} {:>10} {:>10} {:>10} {:>10} {:>10}", "stage", "frames",
+				    "p50", "p99", "p99.9", "max"));
+
+	for (usize i = 0; i < static_cast<usize>(latency::Stage::Count); i++) {
+		const auto stage = static_cast<latency::Stage>(i);
+		const Histogram &histogram = latency::histogram(stage);
+
+		const u64 count = histogram.count();
+		const f64 p50 = us(histogram.percentile(0.5));
+		const f64 p99 = us(histogram.percentile(0.99));
+		const f64 p999 = us(histogram.percentile(0.999));
+		const f64 max = us(histogram.max());
+
+		lines.push_back(fmt::format("{:<10} {:>10} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}",
+					    latency::name(stage), count, p50, p99, p999, max));
+	}
+
+	return lines;
+}
+
+/*!
+ * Writes the latencies that were recorded for every stage to a file, or to the log.
+ *
+ * @param[in] path The file to write the table to. If empty, the table is logged.
+ */
+inline void write_latency_report(const std::optional<std::filesystem::path> &path)
+{
+	const std::vector<std::string> lines = latency_report();
+
+	if (!path.has_value()) {
+		spdlog::info("Latencies (in μs):");
+
+		for (const std::string &line : lines)
+			spdlog::info(line);
+
+		return;
+	}
+
+	std::ofstream file {*path};
+	if (!file)
+		throw std::runtime_error {"Failed to open " + path->string()};
+
+	for (const std::string &line : lines)
+		file << line << '\n';
+
+	spdlog::info("Wrote latencies to {}", path->string());
+}
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_LATENCY_REPORT_HPP
@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_CAPTURE_READER_HPP
+#define IPTSD_CORE_LINUX_CAPTURE_READER_HPP
+
+#include "file-input.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/generic/capture-delta.hpp>
+#include <core/generic/capture.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Reads touch data from a file that was written by iptsd-dump.
+ *
+ * Both the legacy (version 1) and the current (version 2) capture format are supported.
+ * See @ref core/generic/capture.hpp for a description of the formats.
+ */
+class CaptureReader {
+public:
+	struct Frame {
+		// The data that was received from the device.
+		gsl::span<u8> data {};
+
+		// The monotonic time at which the data was received (nanoseconds), if known.
+		std::optional<u64> timestamp = std::nullopt;
+	};
+
+private:
+	// The file that is being read.
+	FileInput m_input;
+
+	// The version of the capture format.
+	u32 m_version = capture::VERSION_1;
+
+	// The flags from the header of the file.
+	u32 m_flags = 0;
+
+	// Information about the device that produced the data.
+	DeviceInfo m_info {};
+
+	// The metadata of the device, if it exists.
+	std::optional<ipts::Metadata> m_metadata = std::nullopt;
+
+	// The offset of the first record in the file.
+	usize m_start = 0;
+
+	// The header of the index, if the file has one.
+	std::optional<capture::IndexHeader> m_index = std::nullopt;
+
+	// The offset of the first index entry in the file.
+	usize m_entries = 0;
+
+	// The offset of the first time bucket in the file.
+	usize m_buckets = 0;
+
+	// The last report of every size, used as the reference for delta decoding.
+	std::unordered_map<u32, std::vector<u8>> m_references {};
+
+	// The buffer for decoded reports.
+	std::vector<u8> m_decoded {};
+
+public:
+	/*!
+	 * Opens a capture file and parses its header.
+	 *
+	 * @param[in] path The file to read. If this is "-", the data is read from stdin.
+	 */
+	CaptureReader(const std::filesystem::path &path) : m_input {path}
+	{
+		const gsl::span<u8> magic = m_input.peek(capture::MAGIC.size());
+
+		if (std::equal(magic.begin(), magic.end(), capture::MAGIC.begin(),
+			       capture::MAGIC.end())) {
+			const auto header = m_input.read<capture::Header>();
+
+			if (header.version != capture::VERSION_2)
+				throw std::runtime_error("Unsupported capture format version!");
+
+			m_version = header.version;
+			m_flags = header.flags;
+		}
+
+		m_info = m_input.read<DeviceInfo>();
+
+		const auto has_meta = m_input.read<u8>();
+		if (has_meta)
+			m_metadata = m_input.read<ipts::Metadata>();
+
+		m_start = m_input.position();
+
+		if (m_version >= capture::VERSION_2 && m_input.seekable())
+			this->load_index();
+	}
+
+	/*!
+	 * The version of the capture format.
+	 */
+	[[nodiscard]] u32 version() const
+	{
+		return m_version;
+	}
+
+	/*!
+	 * Information about the device that produced the data.
+	 */
+	[[nodiscard]] const DeviceInfo &info() const
+	{
+		return m_info;
+	}
+
+	/*!
+	 * The metadata of the device that produced the data, if it exists.
+	 */
+	[[nodiscard]] const std::optional<ipts::Metadata> &metadata() const
+	{
+		return m_metadata;
+	}
+
+	/*!
+	 * Whether reports in the file can be stored as the difference to their predecessor.
+	 */
+	[[nodiscard]] bool delta() const
+	{
+		return (m_flags & capture::FLAG_DELTA) != 0;
+	}
+
+	/*!
+	 * Whether the file is memory mapped and can be read multiple times.
+	 */
+	[[nodiscard]] bool seekable() const
+	{
+		return m_input.seekable();
+	}
+
+	/*!
+	 * Whether the file contains an index, which is needed for seeking to a frame or a time.
+	 */
+	[[nodiscard]] bool indexed() const
+	{
+		return m_index.has_value();
+	}
+
+	/*!
+	 * How many frames the file contains.
+	 *
+	 * @return The amount of frames, or null if the file has no index.
+	 */
+	[[nodiscard]] std::optional<usize> frames() const
+	{
+		if (!m_index.has_value())
+			return std::nullopt;
+
+		return casts::to<usize>(m_index->frames);
+	}
+
+	/*!
+	 * Moves back to the first frame of the file.
+	 *
+	 * Streamed files cannot be rewound, all data that was read once is gone.
+	 */
+	void rewind()
+	{
+		if (!m_input.seekable())
+			return;
+
+		m_input.seek(m_start);
+		m_references.clear();
+	}
+
+	/*!
+	 * Moves to a certain frame of the file.
+	 *
+	 * @param[in] frame The index of the frame that will be returned by the next @ref next call.
+	 */
+	void seek_frame(const usize frame)
+	{
+		if (!m_index.has_value())
+			throw std::runtime_error("Cannot seek in a capture without an index!");
+
+		if (frame >= m_index->frames) {
+			m_input.seek(m_input.size());
+			return;
+		}
+
+		if (!this->delta()) {
+			m_input.seek(casts::to<usize>(this->entry(frame).offset));
+			return;
+		}
+
+		/*
+		 * Delta encoded reports depend on their predecessors. The writer starts over
+		 * at the beginning of every time bucket, so decode from the start of the bucket.
+		 */
+		const u64 start = this->entry(0).timestamp;
+		const u64 time = this->entry(frame).timestamp;
+		const u64 resolution = m_index->resolution;
+
+		const u64 bucket = time > start && resolution > 0 ? (time - start) / resolution : 0;
+
+		// The timestamps don't match the time index, so the index can't be trusted.
+		if (bucket >= m_index->buckets) {
+			m_index = std::nullopt;
+			throw std::runtime_error("Cannot seek in a capture without an index!");
+		}
+
+		const auto first = casts::to<usize>(this->bucket(casts::to<usize>(bucket)));
+
+		m_input.seek(casts::to<usize>(this->entry(std::min(first, frame)).offset));
+		m_references.clear();
+
+		for (usize i = first; i < frame; i++) {
+			if (!this->next().has_value())
+				break;
+		}
+	}
+
+	/*!
+	 * Moves to the first frame that was received at or after a certain time.
+	 *
+	 * @param[in] time The monotonic timestamp to search for (nanoseconds).
+	 */
+	void seek_time(const u64 time)
+	{
+		if (!m_index.has_value())
+			throw std::runtime_error("Cannot seek in a capture without an index!");
+
+		if (m_index->frames == 0 || m_index->buckets == 0 || m_index->resolution == 0) {
+			m_input.seek(m_input.size());
+			return;
+		}
+
+		const u64 start = this->entry(0).timestamp;
+
+		if (time <= start) {
+			this->seek_frame(0);
+			return;
+		}
+
+		const u64 bucket = (time - start) / m_index->resolution;
+
+		if (bucket >= m_index->buckets) {
+			m_input.seek(m_input.size());
+			return;
+		}
+
+		// The bucket points to the first frame of its time window, search from there.
+		auto frame = casts::to<usize>(this->bucket(casts::to<usize>(bucket)));
+
+		while (frame < m_index->frames && this->entry(frame).timestamp < time)
+			frame++;
+
+		this->seek_frame(frame);
+	}
+
+	/*!
+	 * Reads the next frame from the file.
+	 *
+	 * For streamed files, the data is only valid until the next call.
+	 *
+	 * @return The next frame, or null if no complete frame is left.
+	 */
+	std::optional<Frame> next()
+	{
+		if (m_version == capture::VERSION_1)
+			return this->next_v1();
+
+		return this->next_v2();
+	}
+
+	/*!
+	 * Checks whether there is data left that could not be read as a frame.
+	 *
+	 * For streamed files this might block until new data arrives.
+	 *
+	 * @return true if there is leftover data at the current position.
+	 */
+	bool leftover()
+	{
+		if (m_version >= capture::VERSION_2) {
+			const gsl::span<u8> data = m_input.peek(sizeof(capture::Record));
+
+			if (data.empty())
+				return !m_input.empty();
+
+			capture::Record record {};
+			std::memcpy(&record, data.data(), sizeof(record));
+
+			// Hitting the index means that all frames have been read.
+			return record.type != capture::RECORD_TYPE_INDEX;
+		}
+
+		return !m_input.empty();
+	}
+
+private:
+	/*!
+	 * Reads the next frame from a version 1 capture.
+	 *
+	 * This is an error baked into the format.
+	 * The writer should simply write as many bytes as it just received,
+	 * instead of writing the entire buffer all the time.
+	 */
+	std::optional<Frame> next_v1()
+	{
+		const usize record = sizeof(u64) + casts::to<usize>(m_info.buffer_size);
+
+		const gsl::span<u8> data = m_input.take(record);
+		if (data.empty())
+			return std::nullopt;
+
+		u64 size = 0;
+		std::memcpy(&size, data.data(), sizeof(size));
+
+		if (size > m_info.buffer_size)
+			throw std::runtime_error("Invalid report size in capture!");
+
+		return Frame {data.subspan(sizeof(size), casts::to<usize>(size)), std::nullopt};
+	}
+
+	/*!
+	 * Reads the next frame from a version 2 capture.
+	 */
+	std::optional<Frame> next_v2()
+	{
+		while (true) {
+			const gsl::span<u8> header = m_input.peek(sizeof(capture::Record));
+			if (header.empty())
+				return std::nullopt;
+
+			capture::Record record {};
+			std::memcpy(&record, header.data(), sizeof(record));
+
+			// Everything after the index belongs to it, there are no more frames.
+			if (record.type == capture::RECORD_TYPE_INDEX)
+				return std::nullopt;
+
+			/*
+			 * No record is larger than a delta record of the largest report. A corrupt
+			 * size would make streamed files buffer gigabytes before noticing. Such a
+			 * record can't be skipped without reading it, so stop and leave it as
+			 * leftover data.
+			 */
+			const u64 limit = m_info.buffer_size + sizeof(capture::DeltaHeader);
+
+			if (record.size > limit)
+				return std::nullopt;
+
+			const usize size = sizeof(record) + record.size;
+
+			const gsl::span<u8> data = m_input.take(size);
+			if (data.empty())
+				return std::nullopt;
+
+			const u64 timestamp = record.timestamp;
+			const gsl::span<u8> payload = data.subspan(sizeof(record));
+
+			switch (record.type) {
+			case capture::RECORD_TYPE_REPORT:
+				return Frame {this->report(payload), timestamp};
+			case capture::RECORD_TYPE_DELTA:
+				return Frame {this->decode(payload), timestamp};
+			default:
+				// Skip records that we don't understand.
+				continue;
+			}
+		}
+	}
+
+	/*!
+	 * Handles a report that was stored as is.
+	 *
+	 * @param[in] data The contents of the record.
+	 * @return The report.
+	 */
+	gsl::span<u8> report(const gsl::span<u8> data)
+	{
+		if (data.size() > m_info.buffer_size)
+			throw std::runtime_error("Invalid report size in capture!");
+
+		// Keep a copy, the following reports might be stored relative to this one.
+		if (this->delta()) {
+			std::vector<u8> &reference = m_references[casts::to<u32>(data.size())];
+			reference.assign(data.begin(), data.end());
+		}
+
+		return data;
+	}
+
+	/*!
+	 * Handles a report that was stored as the difference to its predecessor.
+	 *
+	 * @param[in] data The contents of the record.
+	 * @return The decoded report. It is only valid until the next call to @ref next.
+	 */
+	gsl::span<u8> decode(const gsl::span<u8> data)
+	{
+		if (data.size() < sizeof(capture::DeltaHeader))
+			throw std::runtime_error("Invalid delta record in capture!");
+
+		capture::DeltaHeader header {};
+		std::memcpy(&header, data.data(), sizeof(header));
+
+		if (header.size > m_info.buffer_size)
+			throw std::runtime_error("Invalid report size in capture!");
+
+		const auto it = m_references.find(header.size);
+		if (it == m_references.end())
+			throw std::runtime_error("Delta record without a reference in capture!");
+
+		std::vector<u8> &reference = it->second;
+
+		/*
+		 * Decode into a copy, so that a record that is only partially applied before
+		 * failing doesn't corrupt the reference for all following records of this size.
+		 * The copy is also handed out, so that the application can't modify the reference.
+		 */
+		m_decoded.assign(reference.begin(), reference.end());
+		capture::delta::decode(data.subspan(sizeof(header)), m_decoded);
+
+		reference.assign(m_decoded.begin(), m_decoded.end());
+		return m_decoded;
+	}
+
+	/*!
+	 * Searches for the index of a version 2 capture and validates it.
+	 *
+	 * Files where the writer was interrupted do not have an index. These can
+	 * still be read from front to back, but don't support seeking.
+	 */
+	void load_index()
+	{
+		const gsl::span<u8> file = m_input.mapping();
+
+		if (file.size() < m_start + sizeof(capture::Footer))
+			return;
+
+		capture::Footer footer {};
+		std::memcpy(&footer, &file[file.size() - sizeof(footer)], sizeof(footer));
+
+		if (footer.magic != capture::MAGIC)
+			return;
+
+		const usize offset = casts::to<usize>(footer.index);
+		const usize end = file.size() - sizeof(footer);
+
+		if (offset < m_start || offset > end)
+			return;
+
+		if (end - offset < sizeof(capture::Record) + sizeof(capture::IndexHeader))
+			return;
+
+		capture::Record record {};
+		std::memcpy(&record, &file[offset], sizeof(record));
+
+		if (record.type != capture::RECORD_TYPE_INDEX)
+			return;
+
+		capture::IndexHeader header {};
+		std::memcpy(&header, &file[offset + sizeof(record)], sizeof(header));
+
+		const usize entries = offset + sizeof(record) + sizeof(header);
+		const usize space = end - entries;
+
+		// The frame and bucket tables must fill exactly the space up to the footer.
+		if (header.frames > space / sizeof(capture::IndexEntry))
+			return;
+
+		const usize frames = casts::to<usize>(header.frames);
+		const usize buckets = entries + (frames * sizeof(capture::IndexEntry));
+
+		if ((end - buckets) % sizeof(u64) != 0)
+			return;
+
+		if (header.buckets != (end - buckets) / sizeof(u64))
+			return;
+
+		m_index = header;
+		m_entries = entries;
+		m_buckets = buckets;
+	}
+
+	/*!
+	 * Reads an entry of the frame index.
+	 *
+	 * @param[in] frame The frame whose entry to read.
+	 * @return The location and timestamp of the frame.
+	 */
+	[[nodiscard]] capture::IndexEntry entry(const usize frame) const
+	{
+		capture::IndexEntry entry {};
+
+		const usize offset = m_entries + (frame * sizeof(entry));
+		std::memcpy(&entry, &m_input.mapping()[offset], sizeof(entry));
+
+		return entry;
+	}
+
+	/*!
+	 * Reads an entry of the time index.
+	 *
+	 * @param[in] bucket The time bucket whose entry to read.
+	 * @return The first frame in that bucket.
+	 */
+	[[nodiscard]] u64 bucket(const usize bucket) const
+	{
+		u64 frame = 0;
+
+		const usize offset = m_buckets + (bucket * sizeof(frame));
+		std::memcpy(&frame, &m_input.mapping()[offset], sizeof(frame));
+
+		return frame;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_CAPTURE_READER_HPP
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_CAPTURE_WRITER_HPP
+#define IPTSD_CORE_LINUX_CAPTURE_WRITER_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+#include <core/generic/capture-delta.hpp>
+#include <core/generic/capture.hpp>
+#include <core/generic/device.hpp>
+#include <ipts/data.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Writes touch data to a file, using version 2 of the capture format.
+ *
+ * See @ref core/generic/capture.hpp for a description of the format.
+ */
+class CaptureWriter {
+private:
+	std::ofstream m_writer {};
+
+	// How many bytes have been written.
+	u64 m_offset = 0;
+
+	// The location and timestamp of every record that was written.
+	std::vector<capture::IndexEntry> m_index {};
+
+	// Whether the index and footer have been written.
+	bool m_finished = false;
+
+	// Whether reports are stored as the difference to their predecessor.
+	bool m_delta = false;
+
+	// The time bucket of the last report that was written.
+	u64 m_bucket = 0;
+
+	// The last report of every size, used as the reference for delta encoding.
+	std::unordered_map<u32, std::vector<u8>> m_references {};
+
+	// The buffer for delta encoded reports.
+	std::vector<u8> m_encoded {};
+
+public:
+	/*!
+	 * Creates a capture file and writes the header.
+	 *
+	 * @param[in] path The file that will be created.
+	 * @param[in] info Information about the device that produced the data.
+	 * @param[in] metadata The metadata of the device, if it exists.
+	 * @param[in] delta Whether to store reports as the difference to their predecessor.
+	 */
+	CaptureWriter(const std::filesystem::path &path,
+		      const DeviceInfo &info,
+		      const std::optional<const ipts::Metadata> &metadata,
+		      const bool delta = false)
+		: m_delta {delta}
+	{
+		m_writer.exceptions(std::ios::badbit | std::ios::failbit);
+		m_writer.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+		capture::Header header {};
+		header.magic = capture::MAGIC;
+		header.version = capture::VERSION_2;
+		header.flags = delta ? capture::FLAG_DELTA : 0;
+
+		this->write_object(header);
+		this->write_object(info);
+
+		const u8 has_meta = metadata.has_value() ? 1 : 0;
+		this->write_object(has_meta);
+
+		if (metadata.has_value())
+			this->write_object(metadata.value());
+	}
+
+	CaptureWriter(const CaptureWriter &) = delete;
+	CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+	~CaptureWriter()
+	{
+		try {
+			this->finish();
+		} catch (std::exception &) {
+			// ignored
+		}
+	}
+
+	/*!
+	 * Appends a report to the file.
+	 *
+	 * @param[in] data The data that was received from the device.
+	 * @param[in] timestamp The monotonic time at which the data was received (nanoseconds).
+	 */
+	void write(const gsl::span<const u8> data, const u64 timestamp)
+	{
+		if (m_finished)
+			throw std::runtime_error("Tried to write to a finished capture!");
+
+		const u32 size = casts::to<u32>(data.size());
+
+		m_index.push_back(capture::IndexEntry {m_offset, timestamp});
+
+		capture::Record record {};
+		record.type = capture::RECORD_TYPE_REPORT;
+		record.size = size;
+		record.timestamp = timestamp;
+
+		if (!m_delta) {
+			this->write_object(record);
+			this->write_bytes(data);
+			return;
+		}
+
+		// Readers can only start decoding at the beginning of a bucket of the time index.
+		const u64 start = m_index.front().timestamp;
+		const u64 elapsed = timestamp > start ? timestamp - start : 0;
+		const u64 bucket = elapsed / capture::INDEX_RESOLUTION;
+
+		if (bucket != m_bucket)
+			m_references.clear();
+
+		m_bucket = bucket;
+
+		std::vector<u8> &reference = m_references[size];
+
+		if (reference.size() == data.size()) {
+			capture::delta::encode(data, reference, m_encoded);
+
+			const capture::DeltaHeader header {size};
+			const usize encoded = sizeof(header) + m_encoded.size();
+
+			if (encoded < data.size()) {
+				record.type = capture::RECORD_TYPE_DELTA;
+				record.size = casts::to<u32>(encoded);
+
+				this->write_object(record);
+				this->write_object(header);
+				this->write_bytes(gsl::span<const u8>(m_encoded));
+
+				std::copy(data.begin(), data.end(), reference.begin());
+				return;
+			}
+		}
+
+		this->write_object(record);
+		this->write_bytes(data);
+
+		reference.assign(data.begin(), data.end());
+	}
+
+	/*!
+	 * Writes the index and the footer and closes the file.
+	 *
+	 * No more data can be written afterwards.
+	 */
+	void finish()
+	{
+		if (m_finished)
+			return;
+
+		m_finished = true;
+
+		const u64 start = m_index.empty() ? 0 : m_index.front().timestamp;
+		const u64 end = m_index.empty() ? 0 : m_index.back().timestamp;
+
+		capture::IndexHeader header {};
+		header.frames = m_index.size();
+		header.resolution = capture::INDEX_RESOLUTION;
+		header.buckets = m_index.empty() ? 0 : (end - start) / header.resolution + 1;
+
+		const usize buckets = casts::to<usize>(header.buckets);
+
+		/*
+		 * For every bucket, find the first frame that was received at or after the
+		 * start of the bucket. The timestamps are monotonic, so one pass is enough.
+		 */
+		std::vector<u64> times(buckets);
+
+		usize frame = 0;
+		for (usize i = 0; i < buckets; i++) {
+			const u64 time = start + (i * header.resolution);
+
+			while (frame < m_index.size() && m_index[frame].timestamp < time)
+				frame++;
+
+			times[i] = frame;
+		}
+
+		usize size = sizeof(header);
+		size += m_index.size() * sizeof(capture::IndexEntry);
+		size += times.size() * sizeof(u64);
+
+		capture::Record record {};
+		record.type = capture::RECORD_TYPE_INDEX;
+		record.size = casts::to<u32>(size);
+		record.timestamp = end;
+
+		capture::Footer footer {};
+		footer.index = m_offset;
+		footer.magic = capture::MAGIC;
+
+		this->write_object(record);
+		this->write_object(header);
+		this->write_bytes(gsl::span<const capture::IndexEntry>(m_index));
+		this->write_bytes(gsl::span<const u64>(times));
+		this->write_object(footer);
+
+		m_writer.close();
+	}
+
+private:
+	/*!
+	 * Writes a trivially copyable object to the file.
+	 *
+	 * @param[in] value The object to write.
+	 */
+	template <class T>
+	void write_object(const T &value)
+	{
+		this->write_bytes(gsl::span<const T> {&value, 1});
+	}
+
+	/*!
+	 * Writes raw memory to the file.
+	 *
+	 * @param[in] data The data to write.
+	 */
+	template <class T>
+	void write_bytes(const gsl::span<T> data)
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		m_writer.write(reinterpret_cast<const char *>(data.data()),
+			       casts::to<std::streamsize>(data.size_bytes()));
+
+		m_offset += data.size_bytes();
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_CAPTURE_WRITER_HPP
@@ -137,6 +137,14 @@ private:
 
 		// clang-format off
 
+		this->get(ini, "Daemon", "ReaderThread", m_config.daemon_reader_thread);
+		this->get(ini, "Daemon", "Overload", m_config.daemon_overload);
+		this->get(ini, "Daemon", "Scheduler", m_config.daemon_scheduler);
+		this->get(ini, "Daemon", "Priority", m_config.daemon_priority);
+		this->get(ini, "Daemon", "CPUs", m_config.daemon_cpus);
+		this->get(ini, "Daemon", "LockMemory", m_config.daemon_lock_memory);
+		this->get(ini, "Daemon", "TimerSlack", m_config.daemon_timer_slack);
+
 		this->get(ini, "Config", "InvertX", m_config.invert_x);
 		this->get(ini, "Config", "InvertY", m_config.invert_y);
 		this->get(ini, "Config", "Width", m_config.width);
@@ -149,6 +157,9 @@ private:
 
 		this->get(ini, "Contacts", "Neutral", m_config.contacts_neutral);
 		this->get(ini, "Contacts", "NeutralValue", m_config.contacts_neutral_value);
+		this->get(ini, "Contacts", "NeutralBackoff", m_config.contacts_neutral_backoff);
+		this->get(ini, "Contacts", "BlurSize", m_config.contacts_blur_size);
+		this->get(ini, "Contacts", "BlurSigma", m_config.contacts_blur_sigma);
 		this->get(ini, "Contacts", "ActivationThreshold", m_config.contacts_activation_threshold);
 		this->get(ini, "Contacts", "DeactivationThreshold", m_config.contacts_deactivation_threshold);
 		this->get(ini, "Contacts", "SizeThresholdMin", m_config.contacts_size_thresh_min);
@@ -163,6 +174,7 @@ private:
 		this->get(ini, "Contacts", "AspectMax", m_config.contacts_aspect_max);
 
 		this->get(ini, "Stylus", "Disable", m_config.stylus_disable);
+		this->get(ini, "Stylus", "AllSamples", m_config.stylus_all_samples);
 		this->get(ini, "Stylus", "TipDistance", m_config.stylus_tip_distance);
 
 		this->get(ini, "DFT", "PositionMinAmp", m_config.dft_position_min_amp);
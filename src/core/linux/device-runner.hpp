@@ -5,10 +5,13 @@
 
 #include "config-loader.hpp"
 #include "hidraw-device.hpp"
+#include "reader-thread.hpp"
 
 #include <common/casts.hpp>
 #include <common/chrono.hpp>
+#include <common/latency.hpp>
 #include <core/generic/application.hpp>
+#include <core/generic/error-report.hpp>
 #include <ipts/data.hpp>
 #include <ipts/device.hpp>
 
@@ -28,6 +31,9 @@ class DeviceRunner {
 private:
 	static_assert(std::is_base_of_v<Application, T>);
 
+	// How many continuous errors are tolerated before giving up.
+	static constexpr usize MAX_ERRORS = 50;
+
 private:
 	// The hidraw device serving as the source of data.
 	std::shared_ptr<HidrawDevice> m_device;
@@ -41,6 +47,16 @@ private:
 	// The target buffer for reading HID reports.
 	std::vector<u8> m_buffer {};
 
+	/*
+	 * Two-thread mode
+	 */
+
+	// Reads reports on a separate thread, if enabled.
+	std::unique_ptr<ReaderThread> m_reader = nullptr;
+
+	// Whether heatmaps are skipped when newer reports are already waiting.
+	bool m_skip_stale = false;
+
 	/*
 	 * deferred initialization
 	 */
@@ -62,10 +78,19 @@ public:
 		const std::optional<const ipts::Metadata> meta = m_ipts.metadata();
 
 		const ConfigLoader loader {info, meta};
-		m_application.emplace(loader.config(), info, meta, args...);
+		const Config config = loader.config();
+
+		m_application.emplace(config, info, meta, args...);
 
 		m_buffer.resize(casts::to<usize>(info.buffer_size));
 
+		m_skip_stale = config.daemon_skip_stale();
+
+		if (config.daemon_reader_thread) {
+			const usize size = m_buffer.size();
+			m_reader = std::make_unique<ReaderThread>(m_device, m_ipts, size);
+		}
+
 		const u16 vendor = info.vendor;
 		const u16 product = info.product;
 
@@ -92,6 +117,26 @@ public:
 	void stop()
 	{
 		m_should_stop = true;
+
+		// Wake up both threads, so they notice the stop request.
+		if (m_reader)
+			m_reader->stop();
+	}
+
+	/*!
+	 * How many reports are currently waiting for the processing thread.
+	 */
+	[[nodiscard]] usize queue_depth() const
+	{
+		return m_reader ? m_reader->depth() : 0;
+	}
+
+	/*!
+	 * The highest amount of reports that were waiting for the processing thread at once.
+	 */
+	[[nodiscard]] usize max_queue_depth() const
+	{
+		return m_reader ? m_reader->max_depth() : 0;
 	}
 
 	/*!
@@ -110,11 +155,48 @@ public:
 		// Signal the application that the data flow has started.
 		m_application->on_start();
 
+		if (m_reader)
+			this->run_threaded();
+		else
+			this->run_single();
+
+		spdlog::info("Stopping");
+
+		// Signal the application that the data flow has stopped.
+		m_application->on_stop();
+
+		log_parse_errors(m_application->parse_errors());
+
+		if (m_reader) {
+			const usize depth = m_reader->max_depth();
+			const usize skipped = m_application->skipped_heatmaps();
+
+			spdlog::info("Reports waited in a queue of up to {}", depth);
+			spdlog::info("Skipped {} stale heatmaps", skipped);
+		}
+
+		try {
+			// Disable multitouch mode
+			m_ipts.set_mode(ipts::Mode::Singletouch);
+		} catch (std::exception &e) {
+			spdlog::error(e.what());
+		}
+
+		return m_should_stop;
+	}
+
+private:
+	/*!
+	 * Reads and processes reports on the calling thread.
+	 */
+	void run_single()
+	{
 		usize errors = 0;
 
 		while (!m_should_stop) {
-			if (errors >= 50) {
-				spdlog::error("Encountered 50 continuous errors, aborting...");
+			if (errors >= MAX_ERRORS) {
+				spdlog::error("Encountered {} continuous errors, aborting...",
+					      errors);
 				break;
 			}
 
@@ -140,20 +222,58 @@ public:
 			// Reset error count.
 			errors = 0;
 		}
+	}
 
-		spdlog::info("Stopping");
+	/*!
+	 * Reads reports on a separate thread and processes them on the calling thread.
+	 *
+	 * Depending on the overload policy, heatmaps that already have a newer report waiting
+	 * behind them are skipped. Stylus data is always processed.
+	 */
+	void run_threaded()
+	{
+		m_reader->start();
 
-		// Signal the application that the data flow has stopped.
-		m_application->on_stop();
+		usize errors = 0;
 
-		try {
-			// Disable multitouch mode
-			m_ipts.set_mode(ipts::Mode::Singletouch);
-		} catch (std::exception &e) {
-			spdlog::error(e.what());
+		while (m_reader->running() && !m_should_stop) {
+			if (errors >= MAX_ERRORS) {
+				spdlog::error("Encountered {} continuous errors, aborting...",
+					      errors);
+				break;
+			}
+
+			const std::optional<usize> index = m_reader->pop();
+
+			if (!index.has_value()) {
+				m_reader->wait();
+				continue;
+			}
+
+			// Newer reports are already waiting, so this heatmap would only delay them.
+			const bool stale = m_skip_stale && m_reader->depth() > 0;
+
+			const chrono::steady_clock::time_point received =
+				m_reader->received(*index);
+
+			latency::Stopwatch watch {received};
+			watch.lap(latency::Stage::Queue);
+
+			try {
+				m_application->process(m_reader->data(*index), stale);
+				latency::record_since(latency::Stage::Total, received);
+
+				errors = 0;
+			} catch (std::exception &e) {
+				spdlog::warn(e.what());
+				errors++;
+			}
+
+			m_reader->release(*index);
 		}
 
-		return m_should_stop;
+		m_reader->stop();
+		m_reader->join();
 	}
 };
 
@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_FILE_INPUT_HPP
+#define IPTSD_CORE_LINUX_FILE_INPUT_HPP
+
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Sequential access to the contents of a file, without loading all of it into memory.
+ *
+ * Regular files are mapped into memory, so the data that is handed out is a view straight
+ * into the mapping. Everything else (stdin, FIFOs, character devices) is streamed through
+ * a buffer that only grows to the size of the largest chunk that was requested at once.
+ */
+class FileInput {
+private:
+	// The minimal size of the buffer that is used for streaming.
+	constexpr static usize STREAM_BUFFER_SIZE = 64 * 1024;
+
+private:
+	// The file descriptor of the input.
+	int m_fd = -1;
+
+	// Whether the file descriptor was opened by us and has to be closed.
+	bool m_owned = false;
+
+	// The memory mapping of the file, if it is a regular file.
+	gsl::span<u8> m_mapping {};
+
+	// The buffer for streamed input.
+	std::vector<u8> m_buffer {};
+
+	// The current position in the mapping / buffer.
+	usize m_head = 0;
+
+	// The end of the valid data in the mapping / buffer.
+	usize m_tail = 0;
+
+	// Whether the stream has no more data to read.
+	bool m_eof = false;
+
+public:
+	/*!
+	 * Opens a file for reading.
+	 *
+	 * @param[in] path The file to read from. If this is "-", stdin will be used.
+	 */
+	FileInput(const std::filesystem::path &path)
+	{
+		if (path == "-") {
+			m_fd = STDIN_FILENO;
+		} else {
+			m_fd = syscalls::open(path, O_RDONLY);
+			m_owned = true;
+		}
+
+		try {
+			const struct stat st = syscalls::fstat(m_fd);
+
+			if (S_ISREG(st.st_mode) && st.st_size > 0)
+				this->map(casts::to_unsigned(st.st_size));
+			else
+				m_buffer.resize(STREAM_BUFFER_SIZE);
+		} catch (std::exception &) {
+			this->close();
+			throw;
+		}
+	}
+
+	FileInput(const FileInput &) = delete;
+	FileInput &operator=(const FileInput &) = delete;
+
+	~FileInput()
+	{
+		this->close();
+	}
+
+	/*!
+	 * Whether the file is memory mapped and supports seeking.
+	 *
+	 * @return true if the input is a regular file.
+	 */
+	[[nodiscard]] bool seekable() const
+	{
+		return !m_mapping.empty();
+	}
+
+	/*!
+	 * The current position in the file.
+	 *
+	 * Only meaningful if the file is @ref seekable.
+	 *
+	 * @return The offset from the start of the file in bytes.
+	 */
+	[[nodiscard]] usize position() const
+	{
+		return m_head;
+	}
+
+	/*!
+	 * The total size of the file.
+	 *
+	 * Only meaningful if the file is @ref seekable.
+	 *
+	 * @return The size of the file in bytes.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_mapping.size();
+	}
+
+	/*!
+	 * Moves the current position to a different offset.
+	 *
+	 * @param[in] offset The new offset from the start of the file in bytes.
+	 */
+	void seek(const usize offset)
+	{
+		if (!this->seekable())
+			throw std::runtime_error("Cannot seek in a streamed file!");
+
+		if (offset > m_mapping.size())
+			throw std::runtime_error("Tried to seek beyond the end of the file!");
+
+		m_head = offset;
+	}
+
+	/*!
+	 * The whole file, if it is memory mapped.
+	 *
+	 * @return A view of the entire contents of the file, or an empty span if it is streamed.
+	 */
+	[[nodiscard]] gsl::span<u8> mapping() const
+	{
+		return m_mapping;
+	}
+
+	/*!
+	 * Returns a view of the data at the current position without consuming it.
+	 *
+	 * For streamed files, the returned view is only valid until the next call
+	 * to @ref peek or @ref take.
+	 *
+	 * @param[in] size How many bytes are needed.
+	 * @return A view of exactly size bytes, or an empty span if the file ends earlier.
+	 */
+	gsl::span<u8> peek(const usize size)
+	{
+		if (!this->fill(size))
+			return {};
+
+		return this->storage().subspan(m_head, size);
+	}
+
+	/*!
+	 * Returns a view of the data at the current position and moves past it.
+	 *
+	 * For streamed files, the returned view is only valid until the next call
+	 * to @ref peek or @ref take.
+	 *
+	 * @param[in] size How many bytes to take.
+	 * @return A view of exactly size bytes, or an empty span if the file ends earlier.
+	 */
+	gsl::span<u8> take(const usize size)
+	{
+		const gsl::span<u8> data = this->peek(size);
+		m_head += data.size();
+
+		return data;
+	}
+
+	/*!
+	 * Reads an object from the current position.
+	 *
+	 * @tparam T The type (and size) of the object to read.
+	 * @return The object that was read.
+	 */
+	template <class T>
+	T read()
+	{
+		T value {};
+
+		const gsl::span<u8> data = this->take(sizeof(value));
+		if (data.empty())
+			throw std::runtime_error("Tried to read more data than available!");
+
+		std::memcpy(&value, data.data(), sizeof(value));
+		return value;
+	}
+
+	/*!
+	 * Checks whether all data has been consumed.
+	 *
+	 * For streamed files this might block until new data arrives.
+	 *
+	 * @return true if there is no data left.
+	 */
+	bool empty()
+	{
+		return !this->fill(1);
+	}
+
+	/*!
+	 * How many bytes are currently available without reading more data.
+	 *
+	 * @return The amount of buffered (or mapped) bytes that have not been consumed.
+	 */
+	[[nodiscard]] usize available() const
+	{
+		return m_tail - m_head;
+	}
+
+private:
+	/*!
+	 * The memory that the current position refers to.
+	 */
+	[[nodiscard]] gsl::span<u8> storage()
+	{
+		if (this->seekable())
+			return m_mapping;
+
+		return m_buffer;
+	}
+
+	/*!
+	 * Makes sure that a certain amount of data is available at the current position.
+	 *
+	 * @param[in] size How many bytes are needed.
+	 * @return Whether enough data is available.
+	 */
+	bool fill(const usize size)
+	{
+		if (this->available() >= size)
+			return true;
+
+		if (this->seekable() || m_eof)
+			return false;
+
+		// Move the remaining data to the front of the buffer and make room for the rest.
+		const auto begin = m_buffer.begin() + casts::to_signed(m_head);
+		const auto end = m_buffer.begin() + casts::to_signed(m_tail);
+
+		std::copy(begin, end, m_buffer.begin());
+
+		m_tail -= m_head;
+		m_head = 0;
+
+		if (m_buffer.size() < size)
+			m_buffer.resize(size);
+
+		while (m_tail < size) {
+			const gsl::span<u8> free = gsl::span<u8>(m_buffer).subspan(m_tail);
+			const isize ret = syscalls::read(m_fd, free);
+
+			if (ret == 0) {
+				m_eof = true;
+				return false;
+			}
+
+			m_tail += casts::to_unsigned(ret);
+		}
+
+		return true;
+	}
+
+	/*!
+	 * Maps a regular file into memory.
+	 *
+	 * The mapping is private and writable, because the parsing code operates on mutable
+	 * spans. Writes never reach the file; they only create private copies of the pages.
+	 *
+	 * @param[in] size The size of the file in bytes.
+	 */
+	void map(const usize size)
+	{
+		const int prot = PROT_READ | PROT_WRITE;
+		void *addr = syscalls::mmap(nullptr, size, prot, MAP_PRIVATE, m_fd);
+
+		// The data is mostly read front to back, let the kernel read ahead aggressively.
+		try {
+			syscalls::madvise(addr, size, MADV_SEQUENTIAL);
+		} catch (std::exception &) {
+			// ignored
+		}
+
+		m_mapping = gsl::span<u8> {static_cast<u8 *>(addr), size};
+		m_tail = size;
+	}
+
+	/*!
+	 * Releases the memory mapping and the file descriptor.
+	 */
+	void close()
+	{
+		try {
+			if (!m_mapping.empty())
+				syscalls::munmap(m_mapping.data(), m_mapping.size());
+
+			if (m_owned)
+				syscalls::close(m_fd);
+		} catch (std::exception &) {
+			// ignored
+		}
+
+		m_mapping = {};
+		m_owned = false;
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_FILE_INPUT_HPP
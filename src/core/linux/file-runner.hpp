@@ -3,21 +3,21 @@
 #ifndef IPTSD_CORE_LINUX_FILE_RUNNER_HPP
 #define IPTSD_CORE_LINUX_FILE_RUNNER_HPP
 
+#include "capture-reader.hpp"
 #include "config-loader.hpp"
 
 #include <common/casts.hpp>
-#include <common/reader.hpp>
 #include <core/generic/application.hpp>
+#include <core/generic/error-report.hpp>
 #include <ipts/data.hpp>
 
 #include <spdlog/spdlog.h>
 
 #include <atomic>
 #include <filesystem>
-#include <fstream>
+#include <optional>
 #include <stdexcept>
 #include <type_traits>
-#include <vector>
 
 namespace iptsd::core::linux {
 
@@ -27,8 +27,8 @@ private:
 	static_assert(std::is_base_of_v<Application, T>);
 
 private:
-	// The contents of the file.
-	std::vector<u8> m_file {};
+	// The capture file that is being read.
+	CaptureReader m_reader;
 
 	// Information about the device that produced the data.
 	DeviceInfo m_info {};
@@ -42,27 +42,23 @@ private:
 
 	// The application that is being executed.
 	std::optional<T> m_application = std::nullopt;
-	std::optional<Reader> m_reader = std::nullopt;
 
 public:
+	/*!
+	 * Opens a file containing touch data, in any version of the capture format.
+	 *
+	 * Regular files are memory mapped, and the reports are passed to the application as views
+	 * into the mapping. Other files (e.g. pipes or "-" for stdin) are streamed through a
+	 * bounded buffer, which means they can only be processed once.
+	 *
+	 * @param[in] path The file to read the data from.
+	 */
 	template <class... Args>
 	FileRunner(const std::filesystem::path &path, Args... args)
+		: m_reader {path}
+		, m_info {m_reader.info()}
 	{
-		std::ifstream ifs {};
-		ifs.open(path, std::ios::in | std::ios::binary);
-
-		std::noskipws(ifs);
-		m_file = std::vector<u8> {std::istream_iterator<u8>(ifs),
-					  std::istream_iterator<u8>()};
-
-		m_reader = Reader {m_file};
-		m_info = m_reader->read<DeviceInfo>();
-
-		std::optional<ipts::Metadata> meta = std::nullopt;
-
-		const auto has_meta = m_reader->read<u8>();
-		if (has_meta)
-			meta = m_reader->read<ipts::Metadata>();
+		const std::optional<const ipts::Metadata> meta = m_reader.metadata();
 
 		const ConfigLoader loader {m_info, meta};
 		m_application.emplace(loader.config(), m_info, meta, args...);
@@ -73,6 +69,18 @@ public:
 		spdlog::info("Loaded from device {:04X}:{:04X}", vendor, product);
 	}
 
+	/*!
+	 * The capture file that is being read.
+	 *
+	 * Can be used to seek to a certain frame or time before calling @ref run.
+	 *
+	 * @return A reference to the reader of the capture file.
+	 */
+	CaptureReader &reader()
+	{
+		return m_reader;
+	}
+
 	/*!
 	 * The application instance that is being run.
 	 *
@@ -102,48 +110,42 @@ public:
 	 * Starts reading from the file until no data is left.
 	 *
 	 * Touch data that is read will be passed to the application that is being executed.
-	 * This function can safely be called multiple times in a row.
+	 * Processing starts at the current position of the reader, and afterwards the reader
+	 * is moved back to the start. This function can safely be called multiple times in a
+	 * row, but streamed files will only contain data during the first run.
 	 */
 	bool run()
 	{
-		if (!m_application.has_value() || !m_reader.has_value())
-			throw std::runtime_error("Error: Application / Reader are null");
-
-		Reader local = m_reader.value();
+		if (!m_application.has_value())
+			throw std::runtime_error("Error: Application is null");
 
 		// Signal the application that the data flow has started.
 		m_application->on_start();
 
-		while (!m_should_stop && local.size() > 0) {
+		while (!m_should_stop) {
 			try {
-				/*
-				 * Abort if there is not enough data left.
-				 */
-				if (local.size() < (sizeof(u64) + m_info.buffer_size))
+				// Abort if there is not enough data left.
+				const std::optional<CaptureReader::Frame> frame = m_reader.next();
+				if (!frame.has_value())
 					break;
 
-				const auto size = local.read<u64>();
-
-				/*
-				 * This is an error baked into the format.
-				 * The writer should simply write as many bytes as it just received,
-				 * instead of writing the entire buffer all the time.
-				 */
-				Reader buffer = local.sub(casts::to<usize>(m_info.buffer_size));
-
-				m_application->process(buffer.subspan(casts::to<usize>(size)));
+				m_application->process(frame->data);
 			} catch (std::exception &e) {
 				spdlog::warn(e.what());
 				continue;
 			}
 		}
 
-		if (!m_should_stop && local.size() > 0)
+		if (!m_should_stop && m_reader.leftover())
 			spdlog::warn("Leftover data at end of input");
 
+		m_reader.rewind();
+
 		// Signal the application that the data flow has stopped.
 		m_application->on_stop();
 
+		log_parse_errors(m_application->parse_errors());
+
 		return m_should_stop;
 	}
 };
@@ -57,6 +57,14 @@ public:
 		}
 	}
 
+	/*!
+	 * The file descriptor of the device, for waiting on it with poll or epoll.
+	 */
+	[[nodiscard]] int fd() const
+	{
+		return m_fd;
+	}
+
 	/*!
 	 * The vendor ID of the device.
 	 */
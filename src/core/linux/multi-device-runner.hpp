@@ -0,0 +1,769 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_MULTI_DEVICE_RUNNER_HPP
+#define IPTSD_CORE_LINUX_MULTI_DEVICE_RUNNER_HPP
+
+#include "config-loader.hpp"
+#include "hidraw-device.hpp"
+#include "reader-thread.hpp"
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/latency.hpp>
+#include <common/trace.hpp>
+#include <common/types.hpp>
+#include <core/generic/application.hpp>
+#include <core/generic/config.hpp>
+#include <core/generic/device.hpp>
+#include <core/generic/error-report.hpp>
+#include <core/generic/latency-report.hpp>
+#include <ipts/data.hpp>
+#include <ipts/device.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Runs one application per device, for multiple devices in a single thread.
+ *
+ * Instead of blocking in a read on one device, the runner waits for all of them at once using
+ * epoll. Requests to stop or to reload the configuration wake up the loop through an eventfd,
+ * so they take effect immediately, even if no device is sending data.
+ *
+ * Devices that are configured to use a reader thread are read on a thread of their own. The
+ * event loop then waits for reports from that thread instead of the device, and processes
+ * them on the calling thread, like all other devices.
+ */
+template <class T>
+class MultiDeviceRunner {
+private:
+	static_assert(std::is_base_of_v<Application, T>);
+
+	using clock = chrono::steady_clock;
+
+	// How many errors in a row will cause a device to be dropped.
+	static constexpr usize MAX_ERRORS = 50;
+
+	// How long a device is ignored after an error, to let it get back into normal state.
+	static constexpr clock::duration ERROR_DELAY = 100ms;
+
+	// The epoll data that identifies the eventfd. Devices are identified by their index.
+	static constexpr u64 EVENT_ID = std::numeric_limits<u64>::max();
+
+	/*
+	 * Everything that belongs to one of the devices.
+	 */
+	struct Source {
+		// The path to the hidraw device.
+		std::filesystem::path path;
+
+		// The hidraw device serving as the source of data.
+		std::shared_ptr<HidrawDevice> device;
+
+		// The IPTS touchscreen interface
+		ipts::Device ipts;
+
+		// Information about the device, for loading the config.
+		DeviceInfo info {};
+
+		// The IPTS device metadata. This does not exist on all devices.
+		std::optional<const ipts::Metadata> metadata;
+
+		// The target buffer for reading HID reports.
+		std::vector<u8> buffer {};
+
+		// Reads reports on a separate thread, if enabled.
+		std::unique_ptr<ReaderThread> reader = nullptr;
+
+		// Whether heatmaps are skipped when newer reports are already waiting.
+		bool skip_stale = false;
+
+		// The application that is processing the data of this device.
+		std::unique_ptr<T> application = nullptr;
+
+		// How long the device can be silent before the application is notified.
+		std::optional<clock::duration> timeout;
+
+		// When the device sent data for the last time.
+		clock::time_point last {};
+
+		// Whether the application was notified that the device went silent.
+		bool idle = false;
+
+		// If the device encountered an error, it is ignored until this point.
+		std::optional<clock::time_point> paused = std::nullopt;
+
+		// How many errors were encountered in a row.
+		usize errors = 0;
+
+		// Whether the device is still being read from.
+		bool active = true;
+
+		Source(const std::filesystem::path &path,
+		       const std::optional<clock::duration> timeout)
+			: path {path}
+			, device {std::make_shared<HidrawDevice>(path)}
+			, ipts {device}
+			, metadata {ipts.metadata()}
+			, timeout {timeout} {};
+
+		/*!
+		 * The file descriptor that the event loop waits for.
+		 *
+		 * @return The eventfd of the reader thread if there is one, the device otherwise.
+		 */
+		[[nodiscard]] int fd() const
+		{
+			if (reader)
+				return reader->event();
+
+			return device->fd();
+		}
+	};
+
+private:
+	// The epoll instance that waits for all devices and the eventfd.
+	int m_epoll = -1;
+
+	// Wakes up the event loop when a stop or reload was requested.
+	int m_event = -1;
+
+	// Whether the event loop should stop.
+	std::atomic_bool m_should_stop = false;
+
+	// Whether the configuration should be reloaded.
+	std::atomic_bool m_should_reload = false;
+
+	// Whether the latencies of the processing stages should be reported.
+	std::atomic_bool m_should_report = false;
+
+	// Where the latencies are written to. If not set, they are logged.
+	std::optional<std::filesystem::path> m_stats_file = std::nullopt;
+
+	// Where the trace of the processing stages is written to, if at all.
+	std::optional<std::filesystem::path> m_trace_file = std::nullopt;
+
+	// Creates the application for a device, using the arguments given to the runner.
+	std::function<std::unique_ptr<T>(const Source &, const Config &)> m_create;
+
+	// All devices that were added to the runner.
+	std::vector<std::unique_ptr<Source>> m_sources {};
+
+public:
+	/*!
+	 * Creates a new runner without any devices.
+	 *
+	 * @param[in] args Additional arguments that are passed to every application.
+	 */
+	template <class... Args>
+	explicit MultiDeviceRunner(Args... args)
+		: m_create {[args...](const Source &source, const Config &config) {
+			return std::make_unique<T>(config, source.info, source.metadata, args...);
+		}}
+	{
+		m_epoll = syscalls::epoll_create1(EPOLL_CLOEXEC);
+		m_event = syscalls::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+		this->watch(m_event, EVENT_ID);
+	}
+
+	~MultiDeviceRunner()
+	{
+		try {
+			syscalls::close(m_event);
+			syscalls::close(m_epoll);
+		} catch (std::exception &) {
+			// ignored
+		}
+	}
+
+	// The runner owns file descriptors, so it can't be copied.
+	MultiDeviceRunner(const MultiDeviceRunner &) = delete;
+	MultiDeviceRunner &operator=(const MultiDeviceRunner &) = delete;
+
+	/*!
+	 * Opens a device and creates an application for it.
+	 *
+	 * @param[in] path The path to the hidraw device.
+	 * @param[in] timeout How long the device can be silent before the application is notified.
+	 */
+	void add(const std::filesystem::path &path,
+		 const std::optional<clock::duration> timeout = std::nullopt)
+	{
+		auto source = std::make_unique<Source>(path, timeout);
+
+		source->info.vendor = source->device->vendor();
+		source->info.product = source->device->product();
+		source->info.buffer_size = source->ipts.buffer_size();
+
+		const ConfigLoader loader {source->info, source->metadata};
+		const Config config = loader.config();
+
+		source->application = m_create(*source, config);
+
+		source->buffer.resize(casts::to<usize>(source->info.buffer_size));
+		source->skip_stale = config.daemon_skip_stale();
+
+		// Whether a reader thread is used can't be changed by reloading the configuration.
+		if (config.daemon_reader_thread) {
+			const usize size = source->buffer.size();
+			const ipts::Device &ipts = source->ipts;
+
+			source->reader = std::make_unique<ReaderThread>(source->device, ipts, size);
+		}
+
+		const u16 vendor = source->info.vendor;
+		const u16 product = source->info.product;
+
+		const std::string name = path.string();
+
+		spdlog::info("Connected to device {:04X}:{:04X} ({})", vendor, product, name);
+
+		m_sources.push_back(std::move(source));
+	}
+
+	/*!
+	 * The application instance that is being run for a device.
+	 *
+	 * @param[in] index The index of the device, in the order they were added.
+	 * @return A reference to the application instance.
+	 */
+	T &application(const usize index)
+	{
+		return *m_sources.at(index)->application;
+	}
+
+	/*!
+	 * Stops the event loop.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for Ctrl-C).
+	 */
+	void stop()
+	{
+		m_should_stop = true;
+		this->notify();
+	}
+
+	/*!
+	 * Reloads the configuration and recreates the applications of all devices.
+	 *
+	 * Recreating the applications also recreates any uinput devices they own.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for SIGHUP).
+	 */
+	void reload()
+	{
+		m_should_reload = true;
+		this->notify();
+	}
+
+	/*!
+	 * Reports how long the processing stages took, as a table of percentiles.
+	 *
+	 * If a trace file was set, the recent trace is written as well.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for SIGUSR1).
+	 */
+	void report()
+	{
+		m_should_report = true;
+		this->notify();
+	}
+
+	/*!
+	 * Sets the file that @ref report writes to, instead of the log.
+	 *
+	 * @param[in] path The file to write the latencies to.
+	 */
+	void stats_file(const std::filesystem::path &path)
+	{
+		m_stats_file = path;
+	}
+
+	/*!
+	 * Sets the file that the trace is written to, by @ref report and when the runner stops.
+	 *
+	 * @param[in] path The file to write the trace to, in the Chrome trace event format.
+	 */
+	void trace_file(const std::filesystem::path &path)
+	{
+		m_trace_file = path;
+	}
+
+	/*!
+	 * Waits for data from all devices in an endless loop.
+	 *
+	 * Touch data that is read will be passed to the application of the device it came from.
+	 *
+	 * @return Whether the loop was stopped on request, instead of running out of devices.
+	 */
+	bool run()
+	{
+		if (m_sources.empty())
+			throw std::runtime_error("Init error: No devices were added");
+
+		for (usize i = 0; i < m_sources.size(); i++)
+			this->start(*m_sources[i], i);
+
+		std::array<struct epoll_event, 16> events {};
+
+		const auto active = [](const std::unique_ptr<Source> &source) {
+			return source->active;
+		};
+
+		while (!m_should_stop) {
+			if (std::none_of(m_sources.begin(), m_sources.end(), active)) {
+				spdlog::error("No devices are left, aborting...");
+				break;
+			}
+
+			const int timeout = this->next_timeout(clock::now());
+			const usize count = syscalls::epoll_wait(m_epoll, events, timeout);
+
+			const clock::time_point now = clock::now();
+
+			for (const struct epoll_event &event : gsl::span {events}.first(count)) {
+				if (event.data.u64 == EVENT_ID) {
+					this->drain();
+					continue;
+				}
+
+				Source &source = *m_sources.at(event.data.u64);
+
+				if (!source.active)
+					continue;
+
+				// The device was removed.
+				if ((event.events & (EPOLLERR | EPOLLHUP)) != 0) {
+					const std::string name = source.path.string();
+					spdlog::error("Lost connection to {}", name);
+					this->drop(source);
+					continue;
+				}
+
+				if (source.reader)
+					this->process(source, now);
+				else
+					this->read(source, now);
+			}
+
+			if (m_should_reload.exchange(false))
+				this->recreate();
+
+			if (m_should_report.exchange(false)) {
+				this->write_report();
+				this->write_trace();
+			}
+
+			this->check_timers(now);
+		}
+
+		spdlog::info("Stopping");
+
+		for (const std::unique_ptr<Source> &source : m_sources) {
+			if (source->active)
+				this->drop(*source);
+		}
+
+		this->write_trace();
+
+		return m_should_stop;
+	}
+
+private:
+	/*!
+	 * Adds a file descriptor to the epoll instance.
+	 *
+	 * @param[in] fd The file descriptor to wait for.
+	 * @param[in] id The value that identifies events of this file descriptor.
+	 */
+	void watch(const int fd, const u64 id) const
+	{
+		struct epoll_event event {};
+
+		event.events = EPOLLIN;
+		event.data.u64 = id;
+
+		syscalls::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+	}
+
+	/*!
+	 * Wakes up the event loop.
+	 *
+	 * Errors are ignored, since this has to be safe to call from a signal handler.
+	 */
+	void notify() const
+	{
+		static_cast<void>(::eventfd_write(m_event, 1));
+	}
+
+	/*!
+	 * Writes the latencies of the processing stages to the stats file or the log.
+	 */
+	void write_report() const
+	{
+		try {
+			write_latency_report(m_stats_file);
+		} catch (std::exception &e) {
+			spdlog::warn(e.what());
+		}
+	}
+
+	/*!
+	 * Writes the recent trace of the processing stages, if a trace file was set.
+	 */
+	void write_trace() const
+	{
+		if (!m_trace_file.has_value())
+			return;
+
+		try {
+			trace::write(*m_trace_file);
+			spdlog::info("Wrote trace to {}", m_trace_file->string());
+		} catch (std::exception &e) {
+			spdlog::warn(e.what());
+		}
+	}
+
+	/*!
+	 * Resets the eventfd after it woke up the event loop.
+	 */
+	void drain() const
+	{
+		eventfd_t value = 0;
+		static_cast<void>(::eventfd_read(m_event, &value));
+	}
+
+	/*!
+	 * Starts the data flow of a device.
+	 *
+	 * @param[in] source The device to start.
+	 * @param[in] index The index of the device, for identifying its events.
+	 */
+	void start(Source &source, const usize index) const
+	{
+		// Enable multitouch mode
+		source.ipts.set_mode(ipts::Mode::Multitouch);
+
+		this->watch(source.fd(), index);
+		source.last = clock::now();
+
+		if (source.reader)
+			source.reader->start();
+
+		// Signal the application that the data flow has started.
+		source.application->on_start();
+	}
+
+	/*!
+	 * Stops the data flow of a device and removes it from the event loop.
+	 *
+	 * @param[in] source The device to stop.
+	 */
+	void drop(Source &source) const
+	{
+		source.active = false;
+
+		try {
+			syscalls::epoll_ctl(m_epoll, EPOLL_CTL_DEL, source.fd(), nullptr);
+		} catch (std::exception &e) {
+			spdlog::error(e.what());
+		}
+
+		if (source.reader) {
+			source.reader->stop();
+			source.reader->join();
+		}
+
+		// Signal the application that the data flow has stopped.
+		source.application->on_stop();
+
+		log_parse_errors(source.application->parse_errors());
+
+		if (source.reader) {
+			const usize depth = source.reader->max_depth();
+			const usize skipped = source.application->skipped_heatmaps();
+
+			spdlog::info("Reports waited in a queue of up to {}", depth);
+			spdlog::info("Skipped {} stale heatmaps", skipped);
+		}
+
+		try {
+			// Disable multitouch mode
+			source.ipts.set_mode(ipts::Mode::Singletouch);
+		} catch (std::exception &e) {
+			spdlog::error(e.what());
+		}
+	}
+
+	/*!
+	 * Reads a report from a device and passes it to its application.
+	 *
+	 * @param[in] source The device that has data available.
+	 * @param[in] now The time when the event loop woke up.
+	 */
+	void read(Source &source, const clock::time_point now) const
+	{
+		try {
+			latency::Stopwatch watch {};
+
+			const isize size = source.device->read(source.buffer);
+			watch.lap(latency::Stage::Read);
+
+			const clock::time_point received = watch.last();
+
+			source.last = now;
+			source.idle = false;
+
+			// Does this report contain touch data?
+			if (!source.ipts.is_touch_data(source.buffer))
+				return;
+
+			source.application->process(
+				gsl::span<u8>(source.buffer.data(), casts::to_unsigned(size)));
+
+			latency::record_since(latency::Stage::Total, received);
+		} catch (std::exception &e) {
+			spdlog::warn(e.what());
+
+			if (++source.errors >= MAX_ERRORS) {
+				spdlog::error("Encountered {} continuous errors on {}, dropping it",
+					      MAX_ERRORS, source.path.string());
+
+				this->drop(source);
+				return;
+			}
+
+			this->pause(source, now + ERROR_DELAY);
+			return;
+		}
+
+		// Reset error count.
+		source.errors = 0;
+	}
+
+	/*!
+	 * Processes all reports that the reader thread of a device has queued.
+	 *
+	 * Depending on the overload policy, heatmaps that already have a newer report waiting
+	 * behind them are skipped. Stylus data is always processed.
+	 *
+	 * @param[in] source The device whose reader thread has signaled its eventfd.
+	 * @param[in] now The time when the event loop woke up.
+	 */
+	void process(Source &source, const clock::time_point now) const
+	{
+		// The eventfd is readable, so this resets it without blocking.
+		source.reader->wait();
+
+		while (const std::optional<usize> index = source.reader->pop()) {
+			source.last = now;
+			source.idle = false;
+
+			// Newer reports are already waiting, so this heatmap would only delay them.
+			const bool stale = source.skip_stale && source.reader->depth() > 0;
+
+			const clock::time_point received = source.reader->received(*index);
+
+			latency::Stopwatch watch {received};
+			watch.lap(latency::Stage::Queue);
+
+			try {
+				source.application->process(source.reader->data(*index), stale);
+				latency::record_since(latency::Stage::Total, received);
+
+				// Reset error count.
+				source.errors = 0;
+			} catch (std::exception &e) {
+				spdlog::warn(e.what());
+				source.errors++;
+			}
+
+			source.reader->release(*index);
+
+			if (source.errors >= MAX_ERRORS) {
+				spdlog::error("Encountered {} continuous errors on {}, dropping it",
+					      MAX_ERRORS, source.path.string());
+
+				this->drop(source);
+				return;
+			}
+		}
+
+		// The reader thread gave up on the device.
+		if (!source.reader->running()) {
+			spdlog::error("Stopped reading from {}", source.path.string());
+			this->drop(source);
+		}
+	}
+
+	/*!
+	 * Stops waiting for data from a device until a certain point in time.
+	 *
+	 * @param[in] source The device to pause.
+	 * @param[in] until When the device should be resumed.
+	 */
+	void pause(Source &source, const clock::time_point until) const
+	{
+		struct epoll_event event {};
+
+		syscalls::epoll_ctl(m_epoll, EPOLL_CTL_MOD, source.device->fd(), &event);
+		source.paused = until;
+	}
+
+	/*!
+	 * Resumes waiting for data from a device that was paused.
+	 *
+	 * @param[in] source The device to resume.
+	 * @param[in] index The index of the device, for identifying its events.
+	 */
+	void resume(Source &source, const usize index) const
+	{
+		struct epoll_event event {};
+
+		event.events = EPOLLIN;
+		event.data.u64 = index;
+
+		syscalls::epoll_ctl(m_epoll, EPOLL_CTL_MOD, source.device->fd(), &event);
+		source.paused = std::nullopt;
+	}
+
+	/*!
+	 * Resumes paused devices and notifies applications whose device went silent.
+	 *
+	 * @param[in] now The time when the event loop woke up.
+	 */
+	void check_timers(const clock::time_point now)
+	{
+		for (usize i = 0; i < m_sources.size(); i++) {
+			Source &source = *m_sources[i];
+
+			if (!source.active)
+				continue;
+
+			if (source.paused.has_value() && now >= source.paused.value())
+				this->resume(source, i);
+
+			if (!source.timeout.has_value() || source.idle)
+				continue;
+
+			if (now - source.last < source.timeout.value())
+				continue;
+
+			source.idle = true;
+
+			try {
+				source.application->on_timeout();
+			} catch (std::exception &e) {
+				spdlog::warn(e.what());
+			}
+		}
+	}
+
+	/*!
+	 * Calculates how long the event loop can wait before a timer expires.
+	 *
+	 * @param[in] now The current time.
+	 * @return The timeout for epoll_wait in milliseconds, or -1 if there are no timers.
+	 */
+	[[nodiscard]] int next_timeout(const clock::time_point now) const
+	{
+		std::optional<clock::time_point> next = std::nullopt;
+
+		const auto earliest = [&](const clock::time_point point) {
+			next = std::min(next.value_or(point), point);
+		};
+
+		for (const std::unique_ptr<Source> &source : m_sources) {
+			if (!source->active)
+				continue;
+
+			if (source->paused.has_value())
+				earliest(source->paused.value());
+
+			if (source->timeout.has_value() && !source->idle)
+				earliest(source->last + source->timeout.value());
+		}
+
+		if (!next.has_value())
+			return -1;
+
+		if (next.value() <= now)
+			return 0;
+
+		// Round up, waking up too early would just cause another wait.
+		const auto wait = chrono::ceil<chrono::milliseconds>(next.value() - now);
+		return casts::to<int>(wait.count());
+	}
+
+	/*!
+	 * Reloads the configuration and recreates the applications of all devices.
+	 *
+	 * The new application is created before the old one is stopped. If the new configuration
+	 * can't be loaded, or the application can't be created from it, the old application
+	 * keeps running. Recreating an application also recreates any uinput devices it owns.
+	 */
+	void recreate()
+	{
+		spdlog::info("Reloading configuration");
+
+		for (const std::unique_ptr<Source> &source : m_sources) {
+			if (!source->active)
+				continue;
+
+			std::optional<Config> config = std::nullopt;
+			bool skip_stale = false;
+
+			try {
+				config = ConfigLoader {source->info, source->metadata}.config();
+				skip_stale = config->daemon_skip_stale();
+
+				// Catch invalid contact detection settings before anything is torn down.
+				static_cast<void>(config->contacts());
+			} catch (std::exception &e) {
+				spdlog::error("Failed to reload configuration: {}", e.what());
+				continue;
+			}
+
+			std::unique_ptr<T> application = nullptr;
+
+			try {
+				application = m_create(*source, config.value());
+			} catch (std::exception &e) {
+				spdlog::error("Failed to recreate application: {}", e.what());
+				continue;
+			}
+
+			source->application->on_stop();
+
+			source->application = std::move(application);
+			source->skip_stale = skip_stale;
+
+			source->application->on_start();
+		}
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_MULTI_DEVICE_RUNNER_HPP
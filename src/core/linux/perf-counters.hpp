@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
+#define IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
+
+#include "syscalls.hpp"
+
+#include <common/latency.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <exception>
+#include <linux/perf_event.h>
+#include <system_error>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Counts hardware events for every stage of the processing pipeline, using perf_event_open.
+ *
+ * The counters only count the thread that created them, and only in user space. They are
+ * read at the end of every stage, see @ref latency::Stopwatch.
+ *
+ * Events that are not supported by the CPU (or the hypervisor) are left out. If no event
+ * is supported, or the kernel doesn't allow access to the counters at all (see
+ * /proc/sys/kernel/perf_event_paranoid), the counters are unavailable and record nothing.
+ */
+class PerfCounters : public latency::Observer {
+public:
+	enum class Event : u8 {
+		Cycles,
+		Instructions,
+		L1Misses,     // Read misses of the L1 data cache.
+		LlcMisses,    // Misses of the last level cache.
+		BranchMisses, // Mispredicted branches.
+		Count,
+	};
+
+	static constexpr usize EVENTS = static_cast<usize>(Event::Count);
+	static constexpr usize STAGES = static_cast<usize>(latency::Stage::Count);
+
+private:
+	// The file descriptor of every event, or -1 if the event is not supported.
+	std::array<int, EVENTS> m_fds {};
+
+	// The event that leads the group. All events of the group are read at once through it.
+	int m_leader = -1;
+
+	// The events in the order in which the kernel returns their values.
+	std::vector<usize> m_order {};
+
+	// The values of the events at the end of the last stage.
+	std::array<u64, EVENTS> m_last {};
+
+	// The sum of every event over all runs of a stage.
+	std::array<std::array<u64, EVENTS>, STAGES> m_totals {};
+
+	// How often every stage ran.
+	std::array<u64, STAGES> m_laps {};
+
+	// Whether the counters had to share the hardware with other events.
+	bool m_multiplexed = false;
+
+	// The layout of PERF_FORMAT_GROUP: nr, time_enabled, time_running, values[nr].
+	std::array<u64, 3 + EVENTS> m_buffer {};
+
+public:
+	/*!
+	 * Opens a counter for every supported event on the calling thread.
+	 */
+	PerfCounters()
+	{
+		m_fds.fill(-1);
+
+		for (usize i = 0; i < EVENTS; i++) {
+			const auto event = static_cast<Event>(i);
+
+			struct perf_event_attr attr = PerfCounters::attributes(event);
+
+			try {
+				gsl::at(m_fds, i) = syscalls::perf_event_open(attr, m_leader);
+			} catch (std::system_error &e) {
+				const std::error_code code = e.code();
+
+				if (code == std::errc::permission_denied ||
+				    code == std::errc::operation_not_permitted) {
+					spdlog::warn("Access to hardware counters was denied: {}",
+						     e.what());
+					spdlog::warn("Check /proc/sys/kernel/perf_event_paranoid");
+					break;
+				}
+
+				spdlog::warn("Counting {} is not supported: {}", name(event),
+					     e.what());
+				continue;
+			}
+
+			// The first event that is supported leads the group.
+			if (m_leader == -1)
+				m_leader = gsl::at(m_fds, i);
+
+			m_order.push_back(i);
+		}
+
+		if (m_leader == -1)
+			spdlog::warn("Hardware counters are unavailable");
+	}
+
+	~PerfCounters() override
+	{
+		for (const int fd : m_fds) {
+			if (fd == -1)
+				continue;
+
+			try {
+				syscalls::close(fd);
+			} catch (std::exception & /* unused */) {
+				// ignored
+			}
+		}
+	}
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+	PerfCounters(PerfCounters &&) = delete;
+	PerfCounters &operator=(PerfCounters &&) = delete;
+
+	/*!
+	 * A readable name for an event.
+	 *
+	 * @param[in] event The event.
+	 * @return The name of the event.
+	 */
+	static const char *name(const Event event)
+	{
+		switch (event) {
+		case Event::Cycles:
+			return "cycles";
+		case Event::Instructions:
+			return "instructions";
+		case Event::L1Misses:
+			return "L1 misses";
+		case Event::LlcMisses:
+			return "LLC misses";
+		case Event::BranchMisses:
+			return "branch misses";
+		default:
+			return "unknown";
+		}
+	}
+
+	/*!
+	 * Whether any hardware events can be counted.
+	 */
+	[[nodiscard]] bool available() const
+	{
+		return m_leader != -1;
+	}
+
+	/*!
+	 * Whether an event can be counted.
+	 *
+	 * @param[in] event The event.
+	 */
+	[[nodiscard]] bool available(const Event event) const
+	{
+		return gsl::at(m_fds, static_cast<usize>(event)) != -1;
+	}
+
+	/*!
+	 * Whether the counters had to share the hardware with other events.
+	 *
+	 * In this case, the counters were not always running and the values are too low.
+	 */
+	[[nodiscard]] bool multiplexed() const
+	{
+		return m_multiplexed;
+	}
+
+	/*!
+	 * How often a stage ran while the counters were observing.
+	 *
+	 * @param[in] stage The stage.
+	 */
+	[[nodiscard]] u64 laps(const latency::Stage stage) const
+	{
+		return gsl::at(m_laps, static_cast<usize>(stage));
+	}
+
+	/*!
+	 * How often an event happened during all runs of a stage.
+	 *
+	 * @param[in] stage The stage.
+	 * @param[in] event The event.
+	 */
+	[[nodiscard]] u64 total(const latency::Stage stage, const Event event) const
+	{
+		const auto &totals = gsl::at(m_totals, static_cast<usize>(stage));
+		return gsl::at(totals, static_cast<usize>(event));
+	}
+
+	void start() override
+	{
+		this->read(m_last);
+	}
+
+	void lap(const latency::Stage stage) override
+	{
+		std::array<u64, EVENTS> now {};
+		this->read(now);
+
+		auto &totals = gsl::at(m_totals, static_cast<usize>(stage));
+
+		for (const usize i : m_order)
+			gsl::at(totals, i) += gsl::at(now, i) - gsl::at(m_last, i);
+
+		gsl::at(m_laps, static_cast<usize>(stage))++;
+		m_last = now;
+	}
+
+private:
+	/*!
+	 * Describes an event to the kernel.
+	 *
+	 * @param[in] event The event.
+	 * @return The attributes for perf_event_open.
+	 */
+	static struct perf_event_attr attributes(const Event event)
+	{
+		struct perf_event_attr attr {};
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+
+		// Only count the code of iptsd, this also needs less permissions.
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		switch (event) {
+		case Event::Cycles:
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		case Event::Instructions:
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case Event::L1Misses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+		case Event::LlcMisses:
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			break;
+		case Event::BranchMisses:
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+		default:
+			break;
+		}
+
+		return attr;
+	}
+
+	/*!
+	 * Reads the current values of all events.
+	 *
+	 * @param[out] values The value of every event. Unsupported events are not touched.
+	 */
+	void read(std::array<u64, EVENTS> &values)
+	{
+		if (m_leader == -1)
+			return;
+
+		syscalls::read(m_leader, gsl::span<u64> {m_buffer});
+
+		const u64 enabled = m_buffer[1];
+		const u64 running = m_buffer[2];
+
+		if (running < enabled)
+			m_multiplexed = true;
+
+		for (usize i = 0; i < m_order.size(); i++)
+			gsl::at(values, m_order[i]) = gsl::at(m_buffer, 3 + i);
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_PERF_COUNTERS_HPP
@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_READER_THREAD_HPP
+#define IPTSD_CORE_LINUX_READER_THREAD_HPP
+
+#include "hidraw-device.hpp"
+#include "syscalls.hpp"
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/latency.hpp>
+#include <common/spsc-queue.hpp>
+#include <common/types.hpp>
+#include <ipts/device.hpp>
+
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace iptsd::core::linux {
+
+/*
+ * Reads touch data reports from a device on a separate thread.
+ *
+ * The reports are read into a pool of preallocated buffers, whose indices are passed to the
+ * processing thread through a lock-free queue. If processing a report takes longer than the
+ * device needs to send the next one, the reports wait in that queue instead of piling up in
+ * the kernel. When all buffers are in use, no more reports are read until one is released.
+ *
+ * The processing side is notified through an eventfd, so it can either block on it or wait
+ * for it together with other file descriptors.
+ */
+class ReaderThread {
+private:
+	// How many reports can be read ahead of the processing thread.
+	static constexpr usize POOL_SIZE = 16;
+
+	// How many continuous errors are tolerated before giving up.
+	static constexpr usize MAX_ERRORS = 50;
+
+	/*
+	 * A preallocated buffer that the reader thread fills with one report.
+	 */
+	struct Report {
+		std::vector<u8> data {};
+		usize size = 0;
+
+		// When reading the report from the device finished.
+		chrono::steady_clock::time_point received {};
+	};
+
+private:
+	// The hidraw device serving as the source of data.
+	std::shared_ptr<HidrawDevice> m_device;
+
+	// The IPTS touchscreen interface, for filtering out reports without touch data.
+	const ipts::Device &m_ipts;
+
+	// Whether the reader thread should keep running.
+	std::atomic_bool m_running = false;
+
+	// The buffers that are shared between the reader and the processing thread.
+	std::array<Report, POOL_SIZE> m_pool {};
+
+	// Reports that were read and are waiting to be processed.
+	SpscQueue<usize, POOL_SIZE> m_ready {};
+
+	// Buffers that were processed and can be filled again.
+	SpscQueue<usize, POOL_SIZE> m_free {};
+
+	// Wakes up the processing thread when a report was queued.
+	int m_ready_event = -1;
+
+	// Wakes up the reader thread when a buffer was released.
+	int m_free_event = -1;
+
+	// The highest amount of reports that were waiting at the same time.
+	std::atomic<usize> m_max_depth = 0;
+
+	// The thread that is reading from the device.
+	std::thread m_thread {};
+
+public:
+	/*!
+	 * Creates a reader for a device, without starting it.
+	 *
+	 * @param[in] device The hidraw device to read from.
+	 * @param[in] ipts The IPTS interface of the device. Must outlive the reader.
+	 * @param[in] size The size of the largest report the device can send.
+	 */
+	ReaderThread(std::shared_ptr<HidrawDevice> device,
+		     const ipts::Device &ipts,
+		     const usize size)
+		: m_device {std::move(device)}
+		, m_ipts {ipts}
+	{
+		for (usize i = 0; i < POOL_SIZE; i++) {
+			gsl::at(m_pool, i).data.resize(size);
+			m_free.push(i);
+		}
+
+		m_ready_event = syscalls::eventfd(0, EFD_CLOEXEC);
+		m_free_event = syscalls::eventfd(0, EFD_CLOEXEC);
+	}
+
+	~ReaderThread()
+	{
+		this->stop();
+		this->join();
+
+		try {
+			syscalls::close(m_ready_event);
+			syscalls::close(m_free_event);
+		} catch (std::exception &) {
+			// ignored
+		}
+	}
+
+	// The reader owns a thread and file descriptors, so it can't be copied or moved.
+	ReaderThread(const ReaderThread &) = delete;
+	ReaderThread &operator=(const ReaderThread &) = delete;
+	ReaderThread(ReaderThread &&) = delete;
+	ReaderThread &operator=(ReaderThread &&) = delete;
+
+	/*!
+	 * Starts reading from the device.
+	 */
+	void start()
+	{
+		m_running = true;
+		m_thread = std::thread {[&] { this->read_reports(); }};
+	}
+
+	/*!
+	 * Asks the reader thread to stop, and wakes up both sides so they notice.
+	 *
+	 * This function is designed to be called from a signal handler (e.g. for Ctrl-C).
+	 */
+	void stop()
+	{
+		m_running = false;
+
+		static_cast<void>(::eventfd_write(m_ready_event, 1));
+		static_cast<void>(::eventfd_write(m_free_event, 1));
+	}
+
+	/*!
+	 * Waits for the reader thread to exit.
+	 */
+	void join()
+	{
+		if (m_thread.joinable())
+			m_thread.join();
+	}
+
+	/*!
+	 * Whether the reader thread is still reading from the device.
+	 *
+	 * It stops on its own if the device was removed or sent too many errors in a row.
+	 */
+	[[nodiscard]] bool running() const
+	{
+		return m_running;
+	}
+
+	/*!
+	 * The eventfd that is signaled when a report was queued or the reader thread stopped.
+	 *
+	 * It only becomes readable if something happened, so it can be waited for using poll
+	 * or epoll. Once it is readable, @ref wait will reset it without blocking.
+	 */
+	[[nodiscard]] int event() const
+	{
+		return m_ready_event;
+	}
+
+	/*!
+	 * Blocks until a report was queued or the reader thread stopped.
+	 */
+	void wait() const
+	{
+		ReaderThread::wait(m_ready_event);
+	}
+
+	/*!
+	 * Takes the oldest report out of the queue.
+	 *
+	 * @return The index of the report, or nothing if no report is waiting.
+	 */
+	std::optional<usize> pop()
+	{
+		return m_ready.pop();
+	}
+
+	/*!
+	 * The data of a report that was taken out of the queue.
+	 *
+	 * @param[in] index The index returned by @ref pop.
+	 * @return The data of the report. Valid until the report is released.
+	 */
+	gsl::span<u8> data(const usize index)
+	{
+		Report &report = gsl::at(m_pool, index);
+		return gsl::span<u8> {report.data.data(), report.size};
+	}
+
+	/*!
+	 * When a report that was taken out of the queue was read from the device.
+	 *
+	 * @param[in] index The index returned by @ref pop.
+	 * @return The time when reading the report finished.
+	 */
+	[[nodiscard]] chrono::steady_clock::time_point received(const usize index) const
+	{
+		return gsl::at(m_pool, index).received;
+	}
+
+	/*!
+	 * Passes the buffer of a processed report back to the reader thread.
+	 *
+	 * @param[in] index The index returned by @ref pop.
+	 */
+	void release(const usize index)
+	{
+		// The pool has exactly as many buffers as the queue can hold.
+		m_free.push(index);
+		static_cast<void>(::eventfd_write(m_free_event, 1));
+	}
+
+	/*!
+	 * How many reports are currently waiting for the processing thread.
+	 */
+	[[nodiscard]] usize depth() const
+	{
+		return m_ready.size();
+	}
+
+	/*!
+	 * The highest amount of reports that were waiting for the processing thread at once.
+	 */
+	[[nodiscard]] usize max_depth() const
+	{
+		return m_max_depth;
+	}
+
+private:
+	/*!
+	 * Fills the buffers from the pool with reports and passes them to the processing thread.
+	 *
+	 * If all buffers are in use, no more reports are read until one is released.
+	 */
+	void read_reports()
+	{
+		std::array<struct pollfd, 2> fds {};
+
+		fds[0].fd = m_device->fd();
+		fds[0].events = POLLIN;
+		fds[1].fd = m_free_event;
+		fds[1].events = POLLIN;
+
+		std::optional<usize> index = std::nullopt;
+		usize errors = 0;
+
+		while (m_running) {
+			if (errors >= MAX_ERRORS) {
+				spdlog::error("Encountered {} continuous errors, aborting...",
+					      errors);
+				break;
+			}
+
+			if (!index.has_value())
+				index = m_free.pop();
+
+			if (!index.has_value()) {
+				ReaderThread::wait(m_free_event);
+				continue;
+			}
+
+			try {
+				if (syscalls::poll(fds, -1) == 0)
+					continue;
+
+				// Reset the event, the next iteration checks why it was signaled.
+				if ((fds[1].revents & POLLIN) != 0)
+					ReaderThread::wait(m_free_event);
+
+				// The device was removed.
+				if ((fds[0].revents & (POLLERR | POLLHUP)) != 0) {
+					spdlog::error("Lost connection to the device");
+					break;
+				}
+
+				if ((fds[0].revents & POLLIN) == 0)
+					continue;
+
+				Report &report = gsl::at(m_pool, *index);
+
+				latency::Stopwatch watch {};
+
+				report.size = casts::to_unsigned(m_device->read(report.data));
+				watch.lap(latency::Stage::Read);
+
+				report.received = watch.last();
+
+				// Does this report contain touch data?
+				if (!m_ipts.is_touch_data(report.data))
+					continue;
+			} catch (std::exception &e) {
+				spdlog::warn(e.what());
+
+				// Sleep for a moment to let the device get back into normal state.
+				std::this_thread::sleep_for(100ms);
+
+				errors++;
+				continue;
+			}
+
+			errors = 0;
+
+			// The pool has exactly as many buffers as the queue can hold.
+			m_ready.push(*index);
+			index.reset();
+
+			const usize depth = m_ready.size();
+			if (depth > m_max_depth)
+				m_max_depth = depth;
+
+			static_cast<void>(::eventfd_write(m_ready_event, 1));
+		}
+
+		m_running = false;
+		static_cast<void>(::eventfd_write(m_ready_event, 1));
+	}
+
+	/*!
+	 * Blocks until an event was signaled and resets it.
+	 *
+	 * @param[in] fd The eventfd to wait for.
+	 */
+	static void wait(const int fd)
+	{
+		eventfd_t value = 0;
+
+		// If this fails, it was interrupted by a signal and the caller checks again.
+		static_cast<void>(::eventfd_read(fd, &value));
+	}
+};
+
+} // namespace iptsd::core::linux
+
+#endif // IPTSD_CORE_LINUX_READER_THREAD_HPP
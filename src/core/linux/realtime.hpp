@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_LINUX_REALTIME_HPP
+#define IPTSD_CORE_LINUX_REALTIME_HPP
+
+#include "syscalls.hpp"
+
+#include <common/types.hpp>
+#include <core/generic/config.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <system_error>
+
+namespace iptsd::core::linux::realtime {
+
+namespace impl {
+
+// How much of the stack is touched in advance, so that using it later doesn't cause page faults.
+constexpr usize STACK_PREFAULT = 128 * 1024;
+
+/*!
+ * Translates the name of a scheduling class into the value used by the kernel.
+ *
+ * @param[in] name The name of the scheduling class (other, fifo or rr).
+ * @return The scheduling policy.
+ */
+inline int scheduler(const std::string &name)
+{
+	if (name == "other")
+		return SCHED_OTHER;
+
+	if (name == "fifo")
+		return SCHED_FIFO;
+
+	if (name == "rr")
+		return SCHED_RR;
+
+	throw std::runtime_error {"Invalid scheduler: " + name};
+}
+
+/*!
+ * Parses a list of CPUs, like "0,2-3".
+ *
+ * @param[in] list The comma separated list of CPUs and ranges of CPUs.
+ * @return The set of CPUs that was described by the list.
+ */
+inline cpu_set_t cpus(const std::string &list)
+{
+	cpu_set_t set {};
+	CPU_ZERO(&set);
+
+	usize start = 0;
+
+	while (start < list.size()) {
+		usize end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+
+		const std::string range = list.substr(start, end - start);
+		const usize dash = range.find('-');
+
+		int first = 0;
+		int last = 0;
+
+		try {
+			first = std::stoi(range.substr(0, dash));
+			last = first;
+
+			if (dash != std::string::npos)
+				last = std::stoi(range.substr(dash + 1));
+		} catch (std::logic_error & /* unused */) {
+			throw std::runtime_error {"Invalid CPU list: " + list};
+		}
+
+		if (first < 0 || last < first || last >= CPU_SETSIZE)
+			throw std::runtime_error {"Invalid CPU list: " + list};
+
+		for (int cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, &set);
+
+		start = end + 1;
+	}
+
+	return set;
+}
+
+/*!
+ * Touches a part of the stack, so that it is already mapped when it is needed.
+ */
+inline void prefault_stack()
+{
+	// Volatile, so that the compiler can't skip writing to the array.
+	std::array<volatile u8, STACK_PREFAULT> stack {};
+
+	for (usize i = 0; i < stack.size(); i += 4096)
+		stack.at(i) = 1;
+}
+
+} // namespace impl
+
+/*!
+ * Applies the real-time settings of the [Daemon] section to the calling thread.
+ *
+ * Threads that are created afterwards inherit the scheduling class and CPU affinity.
+ * Locking memory should happen after all buffers were allocated, because it also faults
+ * in all pages that are already mapped. Pages that are mapped later are locked as well.
+ *
+ * Settings that can't be applied, usually due to missing privileges, are reported
+ * but don't stop the daemon. Invalid settings throw an exception.
+ *
+ * @param[in] config The configuration containing the real-time settings.
+ */
+inline void apply(const Config &config)
+{
+	const std::string &scheduler = config.daemon_scheduler;
+	const i32 priority = config.daemon_priority;
+	const std::string &cpus = config.daemon_cpus;
+	const i32 slack = config.daemon_timer_slack;
+
+	// Parse everything first, so that invalid values don't leave the settings half applied.
+	const int policy = impl::scheduler(scheduler);
+	const cpu_set_t set = impl::cpus(cpus);
+
+	if (policy != SCHED_OTHER || priority != 0) {
+		try {
+			syscalls::sched_setscheduler(policy, priority);
+			spdlog::info("Realtime: Scheduler {}, priority {}", scheduler, priority);
+		} catch (std::system_error &e) {
+			spdlog::warn("Realtime: Failed to set scheduler: {}", e.what());
+		}
+	}
+
+	if (!cpus.empty()) {
+		try {
+			syscalls::sched_setaffinity(set);
+			spdlog::info("Realtime: Pinned to CPUs {}", cpus);
+		} catch (std::system_error &e) {
+			spdlog::warn("Realtime: Failed to pin to CPUs {}: {}", cpus, e.what());
+		}
+	}
+
+	if (config.daemon_lock_memory) {
+		try {
+			syscalls::mlockall(MCL_CURRENT | MCL_FUTURE);
+			impl::prefault_stack();
+
+			spdlog::info("Realtime: Locked memory");
+		} catch (std::system_error &e) {
+			spdlog::warn("Realtime: Failed to lock memory: {}", e.what());
+		}
+	}
+
+	// Negative values leave the timer slack unchanged, zero resets it to the default.
+	if (slack >= 0) {
+		try {
+			syscalls::set_timer_slack(static_cast<unsigned long>(slack));
+
+			if (slack == 0)
+				spdlog::info("Realtime: Timer slack was reset to the default");
+			else
+				spdlog::info("Realtime: Timer slack is {}ns", slack);
+		} catch (std::system_error &e) {
+			spdlog::warn("Realtime: Failed to set timer slack: {}", e.what());
+		}
+	}
+}
+
+} // namespace iptsd::core::linux::realtime
+
+#endif // IPTSD_CORE_LINUX_REALTIME_HPP
@@ -8,7 +8,16 @@
 #include <gsl/gsl>
 
 #include <linux/input.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include <cerrno>
 #include <csignal>
@@ -97,6 +106,174 @@ inline int ioctl(const int fd, const unsigned long rq, T data = nullptr)
 	return ret;
 }
 
+inline struct stat fstat(const int fd)
+{
+	struct stat buf {};
+
+	const int ret = ::fstat(fd, &buf);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return buf;
+}
+
+inline void *mmap(void *addr,
+		  const usize length,
+		  const int prot,
+		  const int flags,
+		  const int fd,
+		  const off_t offset = 0)
+{
+	void *ret = ::mmap(addr, length, prot, flags, fd, offset);
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast,performance-no-int-to-ptr)
+	if (ret == MAP_FAILED)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int munmap(void *addr, const usize length)
+{
+	const int ret = ::munmap(addr, length);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int madvise(void *addr, const usize length, const int advice)
+{
+	const int ret = ::madvise(addr, length, advice);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int eventfd(const unsigned int initval, const int flags)
+{
+	const int ret = ::eventfd(initval, flags);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int epoll_create1(const int flags)
+{
+	const int ret = ::epoll_create1(flags);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int epoll_ctl(const int epfd, const int op, const int fd, struct epoll_event *event)
+{
+	const int ret = ::epoll_ctl(epfd, op, fd, event);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+/*!
+ * Waits for events on an epoll instance.
+ *
+ * Being interrupted by a signal is not treated as an error, since that is
+ * how stop requests from signal handlers end up in the event loop.
+ *
+ * @return The amount of events that were written to the buffer.
+ */
+inline usize epoll_wait(const int epfd,
+			const gsl::span<struct epoll_event> events,
+			const int timeout)
+{
+	const int ret = ::epoll_wait(epfd, events.data(), gsl::narrow<int>(events.size()), timeout);
+
+	if (ret == -1 && errno == EINTR)
+		return 0;
+
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return gsl::narrow_cast<usize>(ret);
+}
+
+/*!
+ * Waits for events on multiple file descriptors.
+ *
+ * Being interrupted by a signal is not treated as an error, like with @ref epoll_wait.
+ *
+ * @return The amount of file descriptors that have events.
+ */
+inline usize poll(const gsl::span<struct pollfd> fds, const int timeout)
+{
+	const int ret = ::poll(fds.data(), fds.size(), timeout);
+
+	if (ret == -1 && errno == EINTR)
+		return 0;
+
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return gsl::narrow_cast<usize>(ret);
+}
+
+inline int sched_setscheduler(const int policy, const int priority)
+{
+	struct sched_param param {};
+	param.sched_priority = priority;
+
+	// Applies to the calling thread.
+	const int ret = ::sched_setscheduler(0, policy, &param);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int sched_setaffinity(const cpu_set_t &cpus)
+{
+	// Applies to the calling thread.
+	const int ret = ::sched_setaffinity(0, sizeof(cpus), &cpus);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int mlockall(const int flags)
+{
+	const int ret = ::mlockall(flags);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int set_timer_slack(const unsigned long nanoseconds)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const int ret = ::prctl(PR_SET_TIMERSLACK, nanoseconds);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return ret;
+}
+
+inline int perf_event_open(struct perf_event_attr &attr, const int group)
+{
+	// Counts the calling thread, on any CPU.
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	const auto ret = ::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+	if (ret == -1)
+		throw std::system_error {impl::last_error()};
+
+	return gsl::narrow_cast<int>(ret);
+}
+
 inline int sigaction(const int sig, const struct sigaction *act, struct sigaction *oact = nullptr)
 {
 	const int ret = ::sigaction(sig, act, oact);
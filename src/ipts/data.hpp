@@ -33,6 +33,13 @@ struct Heatmap {
 	gsl::span<u8> data {};
 };
 
+/*
+ * A DFT window, as a view of the rows inside of the parsed report.
+ *
+ * The rows are not copied out of the report buffer, so the view is only valid
+ * until the parser returns. The parser validated that both views have exactly
+ * as many rows as the window claims to have.
+ */
 struct DftWindow {
 	u8 rows = 0;
 	u8 type = 0;
@@ -40,8 +47,8 @@ struct DftWindow {
 	struct ipts_dimensions dim {};
 	struct ipts_timestamp time {};
 
-	std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> x {};
-	std::array<struct ipts_pen_dft_window_row, IPTS_DFT_MAX_ROWS> y {};
+	gsl::span<const struct ipts_pen_dft_window_row> x {};
+	gsl::span<const struct ipts_pen_dft_window_row> y {};
 };
 
 struct Metadata {
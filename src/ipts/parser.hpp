@@ -5,42 +5,76 @@
 
 #include "data.hpp"
 #include "protocol.hpp"
+#include "validator.hpp"
 
 #include <common/casts.hpp>
+#include <common/latency.hpp>
 #include <common/reader.hpp>
 #include <common/types.hpp>
 
 #include <gsl/gsl>
 
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <cstddef>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace iptsd::ipts {
 
-class Parser {
-public:
-	// The callback that is invoked when stylus data was parsed.
-	std::function<void(const StylusData &)> on_stylus;
-
-	// The callback that is invoked when a capacitive heatmap was parsed.
-	std::function<void(const Heatmap &)> on_heatmap;
-
-	// The callback that is invoked when a DFT window was parsed.
-	std::function<void(const DftWindow &)> on_dft;
-
-	// The callback that is invoked when a metadata report was parsed.
-	std::function<void(const Metadata &)> on_metadata;
-
+/*
+ * Parses IPTS touch data and hands the results to a sink.
+ *
+ * The type of the sink is known at compile time, which allows the compiler to inline the
+ * entire chain from parsing to processing. The sink needs to provide these functions:
+ *
+ *   void on_stylus(const StylusData &);
+ *   void on_heatmap(const Heatmap &);
+ *   void on_dft(const DftWindow &);
+ *   void on_metadata(const Metadata &);
+ *
+ * @tparam Sink The type of the object that receives the parsed data.
+ */
+template <class Sink>
+class BasicParser {
 private:
+	// The object that receives the parsed data.
+	Sink m_sink;
+
 	struct ipts_dimensions m_dim {};
 	struct ipts_timestamp m_time {};
 
+	// Whether every element of a stylus report is passed to the sink, or only the last one.
+	bool m_stylus_samples;
+
+	// How often every type of error was encountered by @ref try_parse.
+	ErrorCounters m_errors {};
+
 public:
+	/*!
+	 * Creates a new parser.
+	 *
+	 * @param[in] sink The object that receives the parsed data.
+	 * @param[in] stylus_samples Whether to pass every stylus sample instead of only the last.
+	 */
+	explicit BasicParser(Sink sink, const bool stylus_samples = false)
+		: m_sink {std::move(sink)}
+		, m_stylus_samples {stylus_samples} {};
+
+	/*!
+	 * The object that receives the parsed data.
+	 */
+	Sink &sink()
+	{
+		return m_sink;
+	}
+
 	/*!
 	 * Parses IPTS touch data from a HID report buffer.
 	 *
@@ -62,16 +96,80 @@ public:
 	template <class T>
 	void parse(const gsl::span<u8> data)
 	{
-		this->parse_with_header(data, sizeof(T));
+		const Status status = this->parse_with_header(data, sizeof(T));
+
+		if (status == Status::Ok)
+			return;
+
+		throw std::runtime_error(std::string {"Malformed IPTS data: "} + describe(status));
+	}
+
+	/*!
+	 * Parses IPTS touch data from a HID report buffer, without throwing exceptions.
+	 *
+	 * The data must have a three byte header, consisting of the report ID and a timestamp.
+	 *
+	 * @param[in] data The data to parse.
+	 * @return Whether the data was parsed, or why it was rejected.
+	 */
+	Status try_parse(const gsl::span<u8> data)
+	{
+		return this->try_parse<struct ipts_header>(data);
+	}
+
+	/*!
+	 * Parses IPTS touch data with an arbitrary header, without throwing exceptions.
+	 *
+	 * Malformed data is counted in @ref errors.
+	 *
+	 * @tparam T The type (and size) of the header.
+	 * @param[in] data The data to parse.
+	 * @return Whether the data was parsed, or why it was rejected.
+	 */
+	template <class T>
+	Status try_parse(const gsl::span<u8> data)
+	{
+		const Status status = this->parse_with_header(data, sizeof(T));
+
+		if (status != Status::Ok)
+			m_errors.add(status);
+
+		return status;
+	}
+
+	/*!
+	 * How often every type of error was encountered by @ref try_parse.
+	 */
+	[[nodiscard]] const ErrorCounters &errors() const
+	{
+		return m_errors;
 	}
 
 private:
-	void parse_with_header(const gsl::span<u8> data, const usize header)
+	/*!
+	 * Validates the structure of the data once, and then decodes it without further checks.
+	 *
+	 * Malformed data is rejected as a whole, nothing is passed to the sink in that case.
+	 *
+	 * @param[in] data The data to parse.
+	 * @param[in] header The size of the header in front of the data.
+	 * @return Whether the data was parsed, or why it was rejected.
+	 */
+	Status parse_with_header(const gsl::span<u8> data, const usize header)
 	{
-		Reader reader(data);
+		latency::Stopwatch watch {};
+
+		const Status status = Validator {m_dim}.validate(data, header);
+		watch.lap(latency::Stage::Parse);
+
+		if (status != Status::Ok)
+			return status;
+
+		UncheckedReader reader {data};
 		reader.skip(header);
 
 		this->parse_frame(reader);
+		return Status::Ok;
 	}
 
 	/*!
@@ -84,10 +182,10 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the root frame.
 	 */
-	void parse_frame(Reader &reader)
+	void parse_frame(UncheckedReader &reader)
 	{
 		const auto header = reader.read<struct ipts_hid_frame>();
-		Reader sub = reader.sub(header.size - sizeof(header));
+		UncheckedReader sub = reader.sub(header.size - sizeof(header));
 
 		// Check if we are dealing with GuC based or HID based IPTS
 		switch (header.type) {
@@ -113,13 +211,13 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the raw data.
 	 */
-	void parse_raw(Reader &reader)
+	void parse_raw(UncheckedReader &reader)
 	{
 		const auto header = reader.read<struct ipts_raw_header>();
 
 		for (u32 i = 0; i < header.frames; i++) {
 			const auto frame = reader.read<struct ipts_raw_frame>();
-			Reader sub = reader.sub(frame.size);
+			UncheckedReader sub = reader.sub(frame.size);
 
 			switch (frame.type) {
 			case IPTS_RAW_FRAME_TYPE_STYLUS:
@@ -142,11 +240,11 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the HID frame.
 	 */
-	void parse_hid(Reader &reader)
+	void parse_hid(UncheckedReader &reader)
 	{
 		while (reader.size() > 0) {
 			const auto frame = reader.read<struct ipts_hid_frame>();
-			Reader sub = reader.sub(frame.size - sizeof(frame));
+			UncheckedReader sub = reader.sub(frame.size - sizeof(frame));
 
 			switch (frame.type) {
 			case IPTS_HID_FRAME_TYPE_HEATMAP:
@@ -182,11 +280,11 @@ private:
 	 * This data is only found on devices that natively support HID and has to be retrieved
 	 * through a HID feature report.
 	 *
-	 * Once the data is parsed, the @ref on_metadata calback is invoked.
+	 * Once the data is parsed, it is passed to the on_metadata function of the sink.
 	 *
 	 * @param[in] reader The chunk of data allocated to the metadata frame.
 	 */
-	void parse_metadata(Reader &reader) const
+	void parse_metadata(UncheckedReader &reader)
 	{
 		Metadata m {};
 
@@ -195,8 +293,7 @@ private:
 		m.transform = reader.read<struct ipts_touch_metadata_transform>();
 		m.unknown = reader.read<struct ipts_touch_metadata_unknown>();
 
-		if (this->on_metadata)
-			this->on_metadata(m);
+		m_sink.on_metadata(m);
 	}
 
 	/*!
@@ -209,11 +306,11 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the list of reports.
 	 */
-	void parse_reports(Reader &reader)
+	void parse_reports(UncheckedReader &reader)
 	{
 		while (reader.size() > 0) {
 			const auto report = reader.read<struct ipts_report>();
-			Reader sub = reader.sub(report.size);
+			UncheckedReader sub = reader.sub(report.size);
 
 			switch (report.type) {
 			case IPTS_REPORT_TYPE_STYLUS_V1:
@@ -249,40 +346,44 @@ private:
 	 *
 	 * The stylus report can contain multiple elements, each describing a different
 	 * sample of the stylus state and position from a 5 millisecond window.
-	 * For the last element, the @ref on_stylus callback will be invoked. The other
-	 * elements are dropped, to prevent jitter in the output. The 1024 pressure levels
-	 *  will be scaled to the same 4096 levels that newer devices support.
+	 * By default, only the last element will be passed to the on_stylus function of the sink.
+	 * The other elements are dropped, to prevent jitter in the output. If stylus samples
+	 * were requested, every element is passed to the sink, in the order they were recorded.
+	 * The 1024 pressure levels will be scaled to the same 4096 levels that newer devices
+	 * support.
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_stylus_v1(Reader &reader) const
+	void parse_stylus_v1(UncheckedReader &reader)
 	{
-		StylusData stylus;
-
 		const auto stylus_report = reader.read<struct ipts_stylus_report>();
-		stylus.serial = stylus_report.serial;
+		const usize elements = std::max<usize>(stylus_report.elements, 1);
 
-		for (u8 i = 0; i < stylus_report.elements - 1; i++)
-			reader.skip(sizeof(struct ipts_stylus_data_v1));
+		// Drop all but the last sample, unless every sample was requested.
+		const usize first = m_stylus_samples ? 0 : elements - 1;
+		reader.skip(first * sizeof(struct ipts_stylus_data_v1));
 
-		const auto data = reader.read<struct ipts_stylus_data_v1>();
+		for (usize i = first; i < elements; i++) {
+			const auto data = reader.read<struct ipts_stylus_data_v1>();
+			StylusData stylus;
 
-		const std::bitset<8> mode {data.mode};
-		stylus.proximity = mode[IPTS_STYLUS_REPORT_MODE_BIT_PROXIMITY];
-		stylus.button = mode[IPTS_STYLUS_REPORT_MODE_BIT_BUTTON];
-		stylus.rubber = mode[IPTS_STYLUS_REPORT_MODE_BIT_RUBBER];
+			const std::bitset<8> mode {data.mode};
+			stylus.proximity = mode[IPTS_STYLUS_REPORT_MODE_BIT_PROXIMITY];
+			stylus.button = mode[IPTS_STYLUS_REPORT_MODE_BIT_BUTTON];
+			stylus.rubber = mode[IPTS_STYLUS_REPORT_MODE_BIT_RUBBER];
 
-		stylus.x = casts::to<f64>(data.x) / IPTS_MAX_X;
-		stylus.y = casts::to<f64>(data.y) / IPTS_MAX_Y;
-		stylus.pressure = casts::to<f64>(data.pressure) / IPTS_MAX_PRESSURE_V1;
-		stylus.azimuth = 0;
-		stylus.altitude = 0;
-		stylus.timestamp = 0;
+			stylus.x = casts::to<f64>(data.x) / IPTS_MAX_X;
+			stylus.y = casts::to<f64>(data.y) / IPTS_MAX_Y;
+			stylus.pressure = casts::to<f64>(data.pressure) / IPTS_MAX_PRESSURE_V1;
+			stylus.azimuth = 0;
+			stylus.altitude = 0;
+			stylus.timestamp = 0;
+			stylus.serial = stylus_report.serial;
 
-		stylus.contact = stylus.pressure > 0;
+			stylus.contact = stylus.pressure > 0;
 
-		if (this->on_stylus)
-			this->on_stylus(stylus);
+			m_sink.on_stylus(stylus);
+		}
 	}
 
 	/*!
@@ -293,40 +394,44 @@ private:
 	 *
 	 * The stylus report can contain multiple elements, each describing a different
 	 * sample of the stylus state and position from a 5 millisecond window.
-	 * For the last element, the @ref on_stylus callback will be invoked. The other
-	 * elements are dropped, to prevent jitter in the output.
+	 * By default, only the last element will be passed to the on_stylus function of the sink.
+	 * The other elements are dropped, to prevent jitter in the output. If stylus samples
+	 * were requested, every element is passed to the sink, in the order they were recorded.
+	 * Every element carries its own timestamp.
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_stylus_v2(Reader &reader) const
+	void parse_stylus_v2(UncheckedReader &reader)
 	{
-		StylusData stylus;
-
 		const auto stylus_report = reader.read<struct ipts_stylus_report>();
-		stylus.serial = stylus_report.serial;
+		const usize elements = std::max<usize>(stylus_report.elements, 1);
 
-		for (u8 i = 0; i < stylus_report.elements - 1; i++)
-			reader.skip(sizeof(struct ipts_stylus_data_v2));
+		// Drop all but the last sample, unless every sample was requested.
+		const usize first = m_stylus_samples ? 0 : elements - 1;
+		reader.skip(first * sizeof(struct ipts_stylus_data_v2));
 
-		const auto data = reader.read<struct ipts_stylus_data_v2>();
+		for (usize i = first; i < elements; i++) {
+			const auto data = reader.read<struct ipts_stylus_data_v2>();
+			StylusData stylus;
 
-		const std::bitset<16> mode(data.mode);
-		stylus.proximity = mode[IPTS_STYLUS_REPORT_MODE_BIT_PROXIMITY];
-		stylus.button = mode[IPTS_STYLUS_REPORT_MODE_BIT_BUTTON];
-		stylus.rubber = mode[IPTS_STYLUS_REPORT_MODE_BIT_RUBBER];
+			const std::bitset<16> mode(data.mode);
+			stylus.proximity = mode[IPTS_STYLUS_REPORT_MODE_BIT_PROXIMITY];
+			stylus.button = mode[IPTS_STYLUS_REPORT_MODE_BIT_BUTTON];
+			stylus.rubber = mode[IPTS_STYLUS_REPORT_MODE_BIT_RUBBER];
 
-		stylus.x = casts::to<f64>(data.x) / IPTS_MAX_X;
-		stylus.y = casts::to<f64>(data.y) / IPTS_MAX_Y;
-		stylus.pressure = casts::to<f64>(data.pressure) / IPTS_MAX_PRESSURE_V2;
-		stylus.timestamp = data.timestamp;
+			stylus.x = casts::to<f64>(data.x) / IPTS_MAX_X;
+			stylus.y = casts::to<f64>(data.y) / IPTS_MAX_Y;
+			stylus.pressure = casts::to<f64>(data.pressure) / IPTS_MAX_PRESSURE_V2;
+			stylus.timestamp = data.timestamp;
+			stylus.serial = stylus_report.serial;
 
-		stylus.azimuth = casts::to<f64>(data.azimuth) / 18000.0 * M_PI;
-		stylus.altitude = casts::to<f64>(data.altitude) / 18000.0 * M_PI;
+			stylus.azimuth = casts::to<f64>(data.azimuth) / 18000.0 * M_PI;
+			stylus.altitude = casts::to<f64>(data.altitude) / 18000.0 * M_PI;
 
-		stylus.contact = stylus.pressure > 0;
+			stylus.contact = stylus.pressure > 0;
 
-		if (this->on_stylus)
-			this->on_stylus(stylus);
+			m_sink.on_stylus(stylus);
+		}
 	}
 
 	/*!
@@ -340,7 +445,7 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_dimensions(Reader &reader)
+	void parse_dimensions(UncheckedReader &reader)
 	{
 		m_dim = reader.read<struct ipts_dimensions>();
 
@@ -354,7 +459,7 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_timestamp(Reader &reader)
+	void parse_timestamp(UncheckedReader &reader)
 	{
 		m_time = reader.read<struct ipts_timestamp>();
 	}
@@ -366,11 +471,11 @@ private:
 	 * heatmaps "inverted", e.g. a contact is represented by a low
 	 * value, and no contact is represented by a high value.
 	 *
-	 * After the data was parsed, the @ref on_heatmap callback will be invoked.
+	 * After the data was parsed, it is passed to the on_heatmap function of the sink.
 	 *
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_heatmap_data(Reader &reader)
+	void parse_heatmap_data(UncheckedReader &reader)
 	{
 		Heatmap heatmap {};
 
@@ -380,8 +485,7 @@ private:
 		heatmap.dim = m_dim;
 		heatmap.time = m_time;
 
-		if (this->on_heatmap)
-			this->on_heatmap(heatmap);
+		m_sink.on_heatmap(heatmap);
 	}
 
 	/*!
@@ -392,10 +496,10 @@ private:
 	 *
 	 * @param[in] reader The chunk of data allocated to the frame.
 	 */
-	void parse_heatmap_frame(Reader &reader)
+	void parse_heatmap_frame(UncheckedReader &reader)
 	{
 		const auto header = reader.read<struct ipts_heatmap_header>();
-		Reader sub = reader.sub(header.size);
+		UncheckedReader sub = reader.sub(header.size);
 
 		this->parse_heatmap_data(sub);
 	}
@@ -408,20 +512,17 @@ private:
 	 * antenna measurements and leave it to the client to determine the exact position
 	 * of the stylus.
 	 *
-	 * After the data was parsed, the @ref on_dft callback will be invoked.
+	 * After the data was parsed, it is passed to the on_dft function of the sink.
 
 	 * @param[in] reader The chunk of data allocated to the report.
 	 */
-	void parse_dft_window(Reader &reader)
+	void parse_dft_window(UncheckedReader &reader)
 	{
 		DftWindow dft {};
 		const auto window = reader.read<struct ipts_pen_dft_window>();
 
-		for (usize i = 0; i < window.num_rows; i++)
-			dft.x.at(i) = reader.read<struct ipts_pen_dft_window_row>();
-
-		for (usize i = 0; i < window.num_rows; i++)
-			dft.y.at(i) = reader.read<struct ipts_pen_dft_window_row>();
+		dft.x = reader.view<struct ipts_pen_dft_window_row>(window.num_rows);
+		dft.y = reader.view<struct ipts_pen_dft_window_row>(window.num_rows);
 
 		dft.rows = window.num_rows;
 		dft.type = window.data_type;
@@ -429,10 +530,118 @@ private:
 		dft.dim = m_dim;
 		dft.time = m_time;
 
-		if (!this->on_dft)
-			return;
+		m_sink.on_dft(dft);
+	}
+};
+
+/*
+ * Parses IPTS touch data and hands the results to runtime configurable callbacks.
+ *
+ * This is a thin adapter around @ref BasicParser for code that doesn't need the best
+ * possible performance. Callbacks that are not set are ignored.
+ */
+class Parser {
+public:
+	// The callback that is invoked when stylus data was parsed.
+	std::function<void(const StylusData &)> on_stylus;
+
+	// The callback that is invoked when a capacitive heatmap was parsed.
+	std::function<void(const Heatmap &)> on_heatmap;
+
+	// The callback that is invoked when a DFT window was parsed.
+	std::function<void(const DftWindow &)> on_dft;
+
+	// The callback that is invoked when a metadata report was parsed.
+	std::function<void(const Metadata &)> on_metadata;
+
+private:
+	/*
+	 * Forwards the parsed data to the callbacks of the parser.
+	 */
+	struct Callbacks {
+		const Parser *parser;
+
+		void on_stylus(const StylusData &data) const
+		{
+			if (parser->on_stylus)
+				parser->on_stylus(data);
+		}
+
+		void on_heatmap(const Heatmap &data) const
+		{
+			if (parser->on_heatmap)
+				parser->on_heatmap(data);
+		}
+
+		void on_dft(const DftWindow &data) const
+		{
+			if (parser->on_dft)
+				parser->on_dft(data);
+		}
+
+		void on_metadata(const Metadata &data) const
+		{
+			if (parser->on_metadata)
+				parser->on_metadata(data);
+		}
+	};
+
+	BasicParser<Callbacks> m_parser;
+
+public:
+	/*!
+	 * Creates a new parser.
+	 *
+	 * @param[in] stylus_samples Whether to pass every stylus sample instead of only the last.
+	 */
+	explicit Parser(const bool stylus_samples = false)
+		: m_parser {Callbacks {this}, stylus_samples} {};
 
-		this->on_dft(dft);
+	// The callbacks are accessed through a pointer to the parser, so it can't be copied.
+	Parser(const Parser &) = delete;
+	Parser &operator=(const Parser &) = delete;
+
+	/*!
+	 * Parses IPTS touch data from a HID report buffer.
+	 *
+	 * The data must have a three byte header, consisting of the report ID and a timestamp.
+	 *
+	 * @param[in] data The data to parse.
+	 */
+	void parse(const gsl::span<u8> data)
+	{
+		m_parser.parse(data);
+	}
+
+	/*!
+	 * Parses IPTS touch data with an arbitrary header.
+	 *
+	 * @tparam T The type (and size) of the header.
+	 * @param[in] data The data to parse.
+	 */
+	template <class T>
+	void parse(const gsl::span<u8> data)
+	{
+		m_parser.template parse<T>(data);
+	}
+
+	/*!
+	 * Parses IPTS touch data from a HID report buffer, without throwing exceptions.
+	 *
+	 * @param[in] data The data to parse.
+	 * @return Whether the data was parsed, or why it was rejected.
+	 */
+	Status try_parse(const gsl::span<u8> data)
+	{
+		return m_parser.try_parse(data);
+	}
+
+	/*!
+	 * How often every type of error was encountered by @ref try_parse.
+	 */
+	[[nodiscard]] const ErrorCounters &errors() const
+	{
+		return m_parser.errors();
 	}
 };
 
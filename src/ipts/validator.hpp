@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_IPTS_VALIDATOR_HPP
+#define IPTSD_IPTS_VALIDATOR_HPP
+
+#include "protocol.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <numeric>
+
+namespace iptsd::ipts {
+
+/*
+ * The result of validating (and parsing) IPTS touch data.
+ */
+enum class Status : u8 {
+	// The data is well formed.
+	Ok,
+
+	// A header or a nested size field points beyond the end of the data.
+	Truncated,
+
+	// A frame claims to be smaller than its own header.
+	InvalidFrameSize,
+
+	// A DFT window has more rows than supported.
+	InvalidDftRows,
+
+	// A heatmap report is smaller than the dimensions of the heatmap.
+	InvalidHeatmapSize,
+
+	// The amount of different status codes.
+	Count,
+};
+
+/*!
+ * A human readable description of a status code.
+ *
+ * @param[in] status The status code to describe.
+ * @return A string describing the status code.
+ */
+inline const char *describe(const Status status)
+{
+	switch (status) {
+	case Status::Ok:
+		return "ok";
+	case Status::Truncated:
+		return "truncated";
+	case Status::InvalidFrameSize:
+		return "invalid frame size";
+	case Status::InvalidDftRows:
+		return "invalid DFT rows";
+	case Status::InvalidHeatmapSize:
+		return "invalid heatmap size";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Counts how often every type of error was encountered.
+ */
+class ErrorCounters {
+private:
+	std::array<usize, static_cast<usize>(Status::Count)> m_counts {};
+
+public:
+	/*!
+	 * Counts one occurrence of an error.
+	 *
+	 * @param[in] status The type of the error.
+	 * @return How often this type of error was encountered, including this time.
+	 */
+	usize add(const Status status)
+	{
+		return ++m_counts.at(static_cast<usize>(status));
+	}
+
+	/*!
+	 * How often a certain type of error was encountered.
+	 *
+	 * @param[in] status The type of the error.
+	 * @return The amount of errors with this type.
+	 */
+	[[nodiscard]] usize get(const Status status) const
+	{
+		return m_counts.at(static_cast<usize>(status));
+	}
+
+	/*!
+	 * How many errors were encountered in total.
+	 *
+	 * @return The amount of errors of all types.
+	 */
+	[[nodiscard]] usize total() const
+	{
+		return std::accumulate(m_counts.begin(), m_counts.end(), usize {0});
+	}
+};
+
+/*
+ * Checks the structure of IPTS touch data, without throwing exceptions.
+ *
+ * This walks through the same frames and reports as the parser, but only checks that all
+ * nested size fields are consistent with each other and with the size of the data. If the
+ * validation succeeds, the parser can decode the data without any further checks.
+ */
+class Validator {
+private:
+	/*
+	 * A view of a chunk of data that reports errors instead of throwing them.
+	 */
+	class Cursor {
+	private:
+		gsl::span<const u8> m_data;
+		usize m_index = 0;
+
+	public:
+		Cursor(const gsl::span<const u8> data) : m_data {data} {};
+
+		[[nodiscard]] usize size() const
+		{
+			return m_data.size() - m_index;
+		}
+
+		[[nodiscard]] bool skip(const usize size)
+		{
+			if (size > this->size())
+				return false;
+
+			m_index += size;
+			return true;
+		}
+
+		template <class T>
+		[[nodiscard]] bool read(T &value)
+		{
+			if (sizeof(value) > this->size())
+				return false;
+
+			std::memcpy(&value, &m_data[m_index], sizeof(value));
+			m_index += sizeof(value);
+
+			return true;
+		}
+
+		[[nodiscard]] bool sub(const usize size, Cursor &out)
+		{
+			if (size > this->size())
+				return false;
+
+			out = Cursor {m_data.subspan(m_index, size)};
+			m_index += size;
+
+			return true;
+		}
+	};
+
+private:
+	// The dimensions of the heatmap that the parser would use.
+	struct ipts_dimensions m_dim;
+
+public:
+	/*!
+	 * Creates a validator.
+	 *
+	 * @param[in] dim The heatmap dimensions that the parser remembered from earlier data.
+	 */
+	Validator(const struct ipts_dimensions &dim) : m_dim {dim} {};
+
+	/*!
+	 * Validates IPTS touch data.
+	 *
+	 * @param[in] data The data to validate.
+	 * @param[in] header The size of the header in front of the data.
+	 * @return Whether the data is well formed, or the first error that was found.
+	 */
+	Status validate(const gsl::span<const u8> data, const usize header)
+	{
+		Cursor cursor {data};
+
+		if (!cursor.skip(header))
+			return Status::Truncated;
+
+		return this->frame(cursor);
+	}
+
+private:
+	Status frame(Cursor &cursor)
+	{
+		struct ipts_hid_frame header {};
+		Cursor sub {{}};
+
+		if (!cursor.read(header))
+			return Status::Truncated;
+
+		if (header.size < sizeof(header))
+			return Status::InvalidFrameSize;
+
+		if (!cursor.sub(header.size - sizeof(header), sub))
+			return Status::Truncated;
+
+		switch (header.type) {
+		case IPTS_HID_FRAME_TYPE_RAW:
+			return this->raw(sub);
+		case IPTS_HID_FRAME_TYPE_HID:
+			return this->hid(sub);
+		default:
+			return Status::Ok;
+		}
+	}
+
+	Status raw(Cursor &cursor)
+	{
+		struct ipts_raw_header header {};
+
+		if (!cursor.read(header))
+			return Status::Truncated;
+
+		for (u32 i = 0; i < header.frames; i++) {
+			struct ipts_raw_frame frame {};
+			Cursor sub {{}};
+
+			if (!cursor.read(frame))
+				return Status::Truncated;
+
+			if (!cursor.sub(frame.size, sub))
+				return Status::Truncated;
+
+			if (frame.type != IPTS_RAW_FRAME_TYPE_STYLUS &&
+			    frame.type != IPTS_RAW_FRAME_TYPE_HEATMAP)
+				continue;
+
+			const Status status = this->reports(sub);
+			if (status != Status::Ok)
+				return status;
+		}
+
+		return Status::Ok;
+	}
+
+	Status hid(Cursor &cursor)
+	{
+		while (cursor.size() > 0) {
+			struct ipts_hid_frame frame {};
+			Cursor sub {{}};
+
+			if (!cursor.read(frame))
+				return Status::Truncated;
+
+			if (frame.size < sizeof(frame))
+				return Status::InvalidFrameSize;
+
+			if (!cursor.sub(frame.size - sizeof(frame), sub))
+				return Status::Truncated;
+
+			Status status = Status::Ok;
+
+			switch (frame.type) {
+			case IPTS_HID_FRAME_TYPE_HEATMAP:
+				status = this->heatmap_frame(sub);
+				break;
+			case IPTS_HID_FRAME_TYPE_REPORTS:
+				// The parser ignores these packets, see BasicParser::parse_hid.
+				if (cursor.size() == 4)
+					return Status::Ok;
+
+				status = this->reports(sub);
+				break;
+			case IPTS_HID_FRAME_TYPE_METADATA:
+				status = this->metadata(sub);
+				break;
+			default:
+				break;
+			}
+
+			if (status != Status::Ok)
+				return status;
+		}
+
+		return Status::Ok;
+	}
+
+	static Status metadata(Cursor &cursor)
+	{
+		usize size = 0;
+
+		size += sizeof(struct ipts_touch_metadata_size);
+		size += sizeof(u8);
+		size += sizeof(struct ipts_touch_metadata_transform);
+		size += sizeof(struct ipts_touch_metadata_unknown);
+
+		if (!cursor.skip(size))
+			return Status::Truncated;
+
+		return Status::Ok;
+	}
+
+	Status reports(Cursor &cursor)
+	{
+		while (cursor.size() > 0) {
+			struct ipts_report report {};
+			Cursor sub {{}};
+
+			if (!cursor.read(report))
+				return Status::Truncated;
+
+			if (!cursor.sub(report.size, sub))
+				return Status::Truncated;
+
+			Status status = Status::Ok;
+
+			switch (report.type) {
+			case IPTS_REPORT_TYPE_STYLUS_V1:
+				status = stylus<struct ipts_stylus_data_v1>(sub);
+				break;
+			case IPTS_REPORT_TYPE_STYLUS_V2:
+				status = stylus<struct ipts_stylus_data_v2>(sub);
+				break;
+			case IPTS_REPORT_TYPE_DIMENSIONS:
+				if (!sub.read(m_dim))
+					status = Status::Truncated;
+
+				break;
+			case IPTS_REPORT_TYPE_TIMESTAMP:
+				if (!sub.skip(sizeof(struct ipts_timestamp)))
+					status = Status::Truncated;
+
+				break;
+			case IPTS_REPORT_TYPE_HEATMAP:
+				status = this->heatmap_data(sub);
+				break;
+			case IPTS_REPORT_TYPE_PEN_DFT_WINDOW:
+				status = dft_window(sub);
+				break;
+			default:
+				break;
+			}
+
+			if (status != Status::Ok)
+				return status;
+		}
+
+		return Status::Ok;
+	}
+
+	template <class T>
+	static Status stylus(Cursor &cursor)
+	{
+		struct ipts_stylus_report report {};
+
+		if (!cursor.read(report))
+			return Status::Truncated;
+
+		// The parser skips to the last element, but always reads at least one.
+		const usize elements = std::max<usize>(report.elements, 1);
+
+		if (elements * sizeof(T) > cursor.size())
+			return Status::Truncated;
+
+		return Status::Ok;
+	}
+
+	[[nodiscard]] Status heatmap_data(Cursor &cursor) const
+	{
+		const usize size = casts::to<usize>(m_dim.width) * m_dim.height;
+
+		if (!cursor.skip(size))
+			return Status::InvalidHeatmapSize;
+
+		return Status::Ok;
+	}
+
+	[[nodiscard]] Status heatmap_frame(Cursor &cursor) const
+	{
+		struct ipts_heatmap_header header {};
+		Cursor sub {{}};
+
+		if (!cursor.read(header))
+			return Status::Truncated;
+
+		if (!cursor.sub(header.size, sub))
+			return Status::Truncated;
+
+		return this->heatmap_data(sub);
+	}
+
+	static Status dft_window(Cursor &cursor)
+	{
+		struct ipts_pen_dft_window window {};
+
+		if (!cursor.read(window))
+			return Status::Truncated;
+
+		if (window.num_rows > IPTS_DFT_MAX_ROWS)
+			return Status::InvalidDftRows;
+
+		const usize rows = casts::to<usize>(window.num_rows) * 2;
+
+		if (!cursor.skip(rows * sizeof(struct ipts_pen_dft_window_row)))
+			return Status::Truncated;
+
+		return Status::Ok;
+	}
+};
+
+} // namespace iptsd::ipts
+
+#endif // IPTSD_IPTS_VALIDATOR_HPP